@@ -0,0 +1,393 @@
+// Microbenchmark for the C++ layer of the three codecs (rexp, geobuf, mvt).
+// Generates large synthetic messages with the generated C++ classes and measures
+// encode (SerializeToString) and decode (ParseFromString). This does not include
+// the conversion from/to R objects or the wire decoders of the package, which
+// need R; see bench.R for those.
+//
+// Each case runs in a forked process, and the peak memory is the growth of the
+// resident set above the start of each operation.
+//
+// Usage: ./bench_codecs [--scale=1] [--reps=3] [--baseline=baseline-cpp.csv] [--save]
+
+#include "rexp.pb.h"
+#include "geobuf.pb.h"
+#include "mvt.pb.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <unistd.h>
+
+typedef std::chrono::steady_clock timer;
+
+struct result {
+  std::string codec;
+  std::string name;
+  std::string op;
+  double bytes;
+  double items;
+  double seconds;
+  long peak_kb;
+};
+
+// A field of /proc/self/status in kB, or -1 if not available (non-linux)
+static long proc_status_kb(const char *field){
+  FILE *fp = fopen("/proc/self/status", "r");
+  if(!fp)
+    return -1;
+  char line[256];
+  long val = -1;
+  size_t len = strlen(field);
+  while(fgets(line, sizeof line, fp)){
+    if(!strncmp(line, field, len)){
+      val = atol(line + len);
+      break;
+    }
+  }
+  fclose(fp);
+  return val;
+}
+
+// Resets the high-water mark of the resident set (linux >= 4.0) and returns the
+// current resident set. Free heap memory is returned to the system first, else
+// an operation could reuse memory of the previous one without growing the peak.
+// Elsewhere ru_maxrss is used, which can not be reset.
+static long reset_peak_rss_kb(){
+#ifdef __GLIBC__
+  malloc_trim(0);
+#endif
+  FILE *fp = fopen("/proc/self/clear_refs", "w");
+  if(fp){
+    fputs("5", fp);
+    fclose(fp);
+  }
+  long rss = proc_status_kb("VmRSS:");
+  if(rss >= 0)
+    return rss;
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+static long peak_rss_kb(){
+  long hwm = proc_status_kb("VmHWM:");
+  if(hwm >= 0)
+    return hwm;
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// Deterministic pseudo random numbers so that runs are comparable
+static uint64_t rng_state = 42;
+static double runif(){
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return (rng_state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* rexp: data frames and nested lists */
+static rexp::REXP make_names(int n, const char *prefix){
+  rexp::REXP out;
+  out.set_rclass(rexp::REXP_RClass_STRING);
+  for(int i = 0; i < n; i++)
+    out.add_stringvalue()->set_strval(prefix + std::to_string(i));
+  return out;
+}
+
+static void add_column(rexp::REXP *col, int type, int nrow){
+  switch(type % 3){
+  case 0:
+    col->set_rclass(rexp::REXP_RClass_REAL);
+    for(int i = 0; i < nrow; i++)
+      col->add_realvalue(runif() * 1000);
+    break;
+  case 1:
+    col->set_rclass(rexp::REXP_RClass_INTEGER);
+    for(int i = 0; i < nrow; i++)
+      col->add_intvalue(runif() * 100000 - 50000);
+    break;
+  case 2:
+    col->set_rclass(rexp::REXP_RClass_STRING);
+    for(int i = 0; i < nrow; i++)
+      col->add_stringvalue()->set_strval("level_" + std::to_string((int) (runif() * 50)));
+    break;
+  }
+}
+
+static rexp::REXP make_dataframe(int nrow, int ncol){
+  rexp::REXP out;
+  out.set_rclass(rexp::REXP_RClass_LIST);
+  for(int j = 0; j < ncol; j++)
+    add_column(out.add_rexpvalue(), j, nrow);
+  out.add_attrname("names");
+  out.add_attrvalue()->CopyFrom(make_names(ncol, "V"));
+  out.add_attrname("class");
+  rexp::REXP *cls = out.add_attrvalue();
+  cls->set_rclass(rexp::REXP_RClass_STRING);
+  cls->add_stringvalue()->set_strval("data.frame");
+  out.add_attrname("row.names");
+  rexp::REXP *rn = out.add_attrvalue();
+  rn->set_rclass(rexp::REXP_RClass_INTEGER);
+  for(int i = 0; i < nrow; i++)
+    rn->add_intvalue(i + 1);
+  return out;
+}
+
+static void make_nested(rexp::REXP *out, int depth, int width){
+  out->set_rclass(rexp::REXP_RClass_LIST);
+  for(int i = 0; i < width; i++){
+    if(depth > 1){
+      make_nested(out->add_rexpvalue(), depth - 1, width);
+    } else {
+      add_column(out->add_rexpvalue(), i, 10);
+    }
+  }
+  out->add_attrname("names");
+  out->add_attrvalue()->CopyFrom(make_names(width, "field"));
+}
+
+/* geobuf: a multipolygon with many vertices */
+static geobuf::Data make_geobuf(int polygons, int vertices){
+  geobuf::Data out;
+  out.set_precision(6);
+  out.set_dimensions(2);
+  out.add_keys("name");
+  geobuf::Data::FeatureCollection *fc = out.mutable_feature_collection();
+  for(int p = 0; p < polygons; p++){
+    geobuf::Data::Feature *feature = fc->add_features();
+    feature->add_properties(0);
+    feature->add_properties(0);
+    feature->add_values()->set_string_value("polygon " + std::to_string(p));
+    geobuf::Data::Geometry *geom = feature->mutable_geometry();
+    geom->set_type(geobuf::Data_Geometry_Type_POLYGON);
+    geom->add_lengths(vertices);
+    double cx = runif() * 360 - 180;
+    double cy = runif() * 170 - 85;
+    int64_t px = 0, py = 0;
+    for(int v = 0; v < vertices; v++){
+      double angle = 2 * M_PI * v / vertices;
+      int64_t x = std::round((cx + cos(angle)) * 1e6);
+      int64_t y = std::round((cy + sin(angle)) * 1e6);
+      geom->add_coords(x - px);
+      geom->add_coords(y - py);
+      px = x;
+      py = y;
+    }
+  }
+  return out;
+}
+
+/* mvt: a dense tile with many small polygons */
+static uint32_t zz(int32_t x){
+  return (x << 1) ^ (x >> 31);
+}
+
+static vector_tile::Tile make_tile(int features, int vertices){
+  vector_tile::Tile out;
+  vector_tile::Tile::Layer *layer = out.add_layers();
+  layer->set_version(2);
+  layer->set_name("dense");
+  layer->set_extent(4096);
+  layer->add_keys("id");
+  layer->add_keys("kind");
+  for(int i = 0; i < 10; i++)
+    layer->add_values()->set_string_value("kind" + std::to_string(i));
+  for(int f = 0; f < features; f++){
+    vector_tile::Tile::Feature *feature = layer->add_features();
+    feature->set_id(f);
+    feature->set_type(vector_tile::Tile::POLYGON);
+    feature->add_tags(1);
+    feature->add_tags(f % 10);
+    int cx = runif() * 4000 + 48;
+    int cy = runif() * 4000 + 48;
+    int x = 0, y = 0;
+    for(int v = 0; v < vertices; v++){
+      double angle = 2 * M_PI * v / vertices;
+      int nx = cx + 40 * cos(angle);
+      int ny = cy + 40 * sin(angle);
+      if(v == 0){
+        feature->add_geometry((1 << 3) | 1);
+      } else if(v == 1){
+        feature->add_geometry(((vertices - 1) << 3) | 2);
+      }
+      feature->add_geometry(zz(nx - x));
+      feature->add_geometry(zz(ny - y));
+      x = nx;
+      y = ny;
+    }
+    feature->add_geometry((1 << 3) | 7);
+  }
+  return out;
+}
+
+// Fastest time of 'reps' runs, and the growth of the resident set in one more
+// run. Memory is only released to the system before that run, such that the
+// timings do not include page faults of memory that the allocator keeps.
+static void measure(std::vector<result> &results, const char *codec, const char *name, const char *op,
+                    double bytes, double items, int reps, const std::function<void()> &fun){
+  double seconds = 1e100;
+  for(int r = 0; r < reps; r++){
+    timer::time_point start = timer::now();
+    fun();
+    seconds = std::min(seconds, std::chrono::duration<double>(timer::now() - start).count());
+  }
+  long start_kb = reset_peak_rss_kb();
+  fun();
+  long peak = peak_rss_kb() - start_kb;
+  result out = {codec, name, op, bytes, items, seconds, peak};
+  results.push_back(out);
+}
+
+template <typename T>
+static void run_ops(std::vector<result> &results, const char *codec, const char *name, const T &message,
+                    double items, int reps){
+  std::string buf;
+  message.SerializeToString(&buf);
+  double bytes = buf.size();
+  measure(results, codec, name, "encode", bytes, items, reps, [&](){
+    std::string out;
+    message.SerializeToString(&out);
+  });
+  measure(results, codec, name, "decode", bytes, items, reps, [&](){
+    T copy;
+    if(!copy.ParseFromString(buf)){
+      fprintf(stderr, "Failed to parse %s/%s\n", codec, name);
+      exit(1);
+    }
+  });
+}
+
+// Generates the message and runs the operations in a child process, such that
+// memory of previous cases does not affect the peak. Results come back over a pipe.
+template <typename T>
+static void run(std::vector<result> &results, const char *codec, const char *name,
+                const std::function<T()> &make, double items, int reps){
+  int fd[2];
+  if(pipe(fd)){
+    perror("pipe");
+    exit(1);
+  }
+  pid_t pid = fork();
+  if(pid == 0){
+    close(fd[0]);
+    std::vector<result> out;
+    run_ops(out, codec, name, make(), items, reps);
+    FILE *fp = fdopen(fd[1], "w");
+    for(size_t i = 0; i < out.size(); i++)
+      fprintf(fp, "%s %.0f %.17g %ld\n", out[i].op.c_str(), out[i].bytes, out[i].seconds, out[i].peak_kb);
+    fclose(fp);
+    _exit(0);
+  }
+  close(fd[1]);
+  FILE *fp = fdopen(fd[0], "r");
+  char op[32];
+  double bytes, seconds;
+  long peak;
+  while(fscanf(fp, "%31s %lf %lf %ld", op, &bytes, &seconds, &peak) == 4){
+    result r = {codec, name, op, bytes, items, seconds, peak};
+    results.push_back(r);
+  }
+  fclose(fp);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  if(!WIFEXITED(status) || WEXITSTATUS(status)){
+    fprintf(stderr, "Benchmark %s/%s failed\n", codec, name);
+    exit(1);
+  }
+}
+
+static std::map<std::string, double> read_baseline(const std::string &path){
+  std::map<std::string, double> out;
+  std::ifstream in(path.c_str());
+  std::string line;
+  std::getline(in, line); // header
+  while(std::getline(in, line)){
+    std::stringstream ss(line);
+    std::string codec, name, op, mbps;
+    std::getline(ss, codec, ',');
+    std::getline(ss, name, ',');
+    std::getline(ss, op, ',');
+    for(int i = 0; i < 3; i++)
+      std::getline(ss, mbps, ',');
+    out[codec + "/" + name + "/" + op] = atof(mbps.c_str());
+  }
+  return out;
+}
+
+int main(int argc, char **argv){
+  double scale = 1;
+  int reps = 3;
+  bool save = false;
+  std::string baseline = "baseline-cpp.csv";
+  for(int i = 1; i < argc; i++){
+    if(!strncmp(argv[i], "--scale=", 8)){
+      scale = atof(argv[i] + 8);
+    } else if(!strncmp(argv[i], "--reps=", 7)){
+      reps = atoi(argv[i] + 7);
+    } else if(!strncmp(argv[i], "--baseline=", 11)){
+      baseline = argv[i] + 11;
+    } else if(!strcmp(argv[i], "--save")){
+      save = true;
+    } else {
+      fprintf(stderr, "Usage: %s [--scale=1] [--reps=3] [--baseline=file] [--save]\n", argv[0]);
+      return 1;
+    }
+  }
+  std::vector<result> results;
+  int nrow = 1000000 * scale;
+  int wide = 1000 * scale;
+  int polygons = 20 * scale;
+  int features = 20000 * scale;
+  run<rexp::REXP>(results, "rexp", "long_df", [&](){ return make_dataframe(nrow, 6); }, nrow, reps);
+  run<rexp::REXP>(results, "rexp", "wide_df", [&](){ return make_dataframe(1000, wide); }, wide, reps);
+  int width = 10 * std::max(1.0, sqrt(scale));
+  run<rexp::REXP>(results, "rexp", "nested_list", [&](){
+    rexp::REXP nested;
+    make_nested(&nested, 4, width);
+    return nested;
+  }, width, reps);
+  run<geobuf::Data>(results, "geobuf", "polygons", [&](){ return make_geobuf(polygons, 100000); },
+                    polygons * 100000.0, reps);
+  run<vector_tile::Tile>(results, "mvt", "dense_tile", [&](){ return make_tile(features, 50); },
+                         features, reps);
+
+  std::map<std::string, double> base = read_baseline(baseline);
+  int regressions = 0;
+  FILE *out = save ? fopen(baseline.c_str(), "w") : NULL;
+  const char *header = "codec,name,op,bytes,seconds,mbps,items_per_sec,peak_mb";
+  printf("%s,vs_baseline\n", header);
+  if(out)
+    fprintf(out, "%s\n", header);
+  for(size_t i = 0; i < results.size(); i++){
+    result r = results[i];
+    double mbps = r.bytes / 1e6 / r.seconds;
+    char line[512];
+    snprintf(line, sizeof line, "%s,%s,%s,%.0f,%.4f,%.1f,%.0f,%.1f", r.codec.c_str(), r.name.c_str(),
+             r.op.c_str(), r.bytes, r.seconds, mbps, r.items / r.seconds, r.peak_kb / 1024.0);
+    std::string key = r.codec + "/" + r.name + "/" + r.op;
+    double ratio = base.count(key) ? mbps / base[key] : NAN;
+    printf("%s,%.2f%s\n", line, ratio, ratio < 0.8 ? " REGRESSION" : "");
+    if(ratio < 0.8)
+      regressions++;
+    if(out)
+      fprintf(out, "%s\n", line);
+  }
+  if(out)
+    fclose(out);
+  google::protobuf::ShutdownProtobufLibrary();
+  return regressions > 0 && !save;
+}
@@ -10,6 +10,115 @@ Rcpp::Rostream<true>&  Rcpp::Rcout = Rcpp::Rcpp_cout_get();
 Rcpp::Rostream<false>& Rcpp::Rcerr = Rcpp::Rcpp_cerr_get();
 #endif
 
+// cpp_unserialize_pb_batch
+Rcpp::List cpp_unserialize_pb_batch(Rcpp::List x, int threads, bool wire);
+RcppExport SEXP _protolite_cpp_unserialize_pb_batch(SEXP xSEXP, SEXP threadsSEXP, SEXP wireSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::List >::type x(xSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type wire(wireSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_unserialize_pb_batch(x, threads, wire));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_mvt_cache_enabled
+bool cpp_mvt_cache_enabled();
+RcppExport SEXP _protolite_cpp_mvt_cache_enabled() {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    rcpp_result_gen = Rcpp::wrap(cpp_mvt_cache_enabled());
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_mvt_cache_key
+std::string cpp_mvt_cache_key(Rcpp::RawVector data, Rcpp::NumericVector zxy, bool as_latlon, bool wkb);
+RcppExport SEXP _protolite_cpp_mvt_cache_key(SEXP dataSEXP, SEXP zxySEXP, SEXP as_latlonSEXP, SEXP wkbSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type data(dataSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type zxy(zxySEXP);
+    Rcpp::traits::input_parameter< bool >::type as_latlon(as_latlonSEXP);
+    Rcpp::traits::input_parameter< bool >::type wkb(wkbSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_mvt_cache_key(data, zxy, as_latlon, wkb));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_mvt_cache_get
+SEXP cpp_mvt_cache_get(std::string key, Rcpp::RawVector data);
+RcppExport SEXP _protolite_cpp_mvt_cache_get(SEXP keySEXP, SEXP dataSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type key(keySEXP);
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type data(dataSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_mvt_cache_get(key, data));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_mvt_cache_put
+void cpp_mvt_cache_put(std::string key, Rcpp::RawVector data, SEXP value);
+RcppExport SEXP _protolite_cpp_mvt_cache_put(SEXP keySEXP, SEXP dataSEXP, SEXP valueSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type key(keySEXP);
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type data(dataSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type value(valueSEXP);
+    cpp_mvt_cache_put(key, data, value);
+    return R_NilValue;
+END_RCPP
+}
+// cpp_mvt_cache_config
+Rcpp::List cpp_mvt_cache_config(double size, bool clear);
+RcppExport SEXP _protolite_cpp_mvt_cache_config(SEXP sizeSEXP, SEXP clearSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< double >::type size(sizeSEXP);
+    Rcpp::traits::input_parameter< bool >::type clear(clearSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_mvt_cache_config(size, clear));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_serialize_pb_chunked
+Rcpp::RawVector cpp_serialize_pb_chunked(Rcpp::RObject x, bool skip_native, bool compact, double segment_size);
+RcppExport SEXP _protolite_cpp_serialize_pb_chunked(SEXP xSEXP, SEXP skip_nativeSEXP, SEXP compactSEXP, SEXP segment_sizeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RObject >::type x(xSEXP);
+    Rcpp::traits::input_parameter< bool >::type skip_native(skip_nativeSEXP);
+    Rcpp::traits::input_parameter< bool >::type compact(compactSEXP);
+    Rcpp::traits::input_parameter< double >::type segment_size(segment_sizeSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_serialize_pb_chunked(x, skip_native, compact, segment_size));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_is_chunked
+bool cpp_is_chunked(Rcpp::RawVector x);
+RcppExport SEXP _protolite_cpp_is_chunked(SEXP xSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type x(xSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_is_chunked(x));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_unserialize_pb_chunked
+Rcpp::RObject cpp_unserialize_pb_chunked(Rcpp::RawVector x);
+RcppExport SEXP _protolite_cpp_unserialize_pb_chunked(SEXP xSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type x(xSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_unserialize_pb_chunked(x));
+    return rcpp_result_gen;
+END_RCPP
+}
 // cpp_serialize_geobuf
 RawVector cpp_serialize_geobuf(List x, int decimals);
 RcppExport SEXP _protolite_cpp_serialize_geobuf(SEXP xSEXP, SEXP decimalsSEXP) {
@@ -22,6 +131,29 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// cpp_hash_pb
+std::string cpp_hash_pb(Rcpp::RObject x, bool skip_native);
+RcppExport SEXP _protolite_cpp_hash_pb(SEXP xSEXP, SEXP skip_nativeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RObject >::type x(xSEXP);
+    Rcpp::traits::input_parameter< bool >::type skip_native(skip_nativeSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_hash_pb(x, skip_native));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_hash_raw
+std::string cpp_hash_raw(Rcpp::RawVector x);
+RcppExport SEXP _protolite_cpp_hash_raw(SEXP xSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type x(xSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_hash_raw(x));
+    return rcpp_result_gen;
+END_RCPP
+}
 // R_start_protobuf
 void R_start_protobuf();
 RcppExport SEXP _protolite_R_start_protobuf() {
@@ -31,29 +163,175 @@ BEGIN_RCPP
     return R_NilValue;
 END_RCPP
 }
+// cpp_inspect_geobuf
+Rcpp::List cpp_inspect_geobuf(Rcpp::RawVector x);
+RcppExport SEXP _protolite_cpp_inspect_geobuf(SEXP xSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type x(xSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_inspect_geobuf(x));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_inspect_mvt
+Rcpp::List cpp_inspect_mvt(Rcpp::RawVector x);
+RcppExport SEXP _protolite_cpp_inspect_mvt(SEXP xSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type x(xSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_inspect_mvt(x));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_kernel_select
+std::string cpp_kernel_select(std::string name);
+RcppExport SEXP _protolite_cpp_kernel_select(SEXP nameSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type name(nameSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_kernel_select(name));
+    return rcpp_result_gen;
+END_RCPP
+}
 // cpp_serialize_pb
-Rcpp::RawVector cpp_serialize_pb(Rcpp::RObject x, bool skip_native);
-RcppExport SEXP _protolite_cpp_serialize_pb(SEXP xSEXP, SEXP skip_nativeSEXP) {
+Rcpp::RawVector cpp_serialize_pb(Rcpp::RObject x, bool skip_native, bool compact);
+RcppExport SEXP _protolite_cpp_serialize_pb(SEXP xSEXP, SEXP skip_nativeSEXP, SEXP compactSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< Rcpp::RObject >::type x(xSEXP);
     Rcpp::traits::input_parameter< bool >::type skip_native(skip_nativeSEXP);
-    rcpp_result_gen = Rcpp::wrap(cpp_serialize_pb(x, skip_native));
+    Rcpp::traits::input_parameter< bool >::type compact(compactSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_serialize_pb(x, skip_native, compact));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_unserialize_pb_slice
+Rcpp::RObject cpp_unserialize_pb_slice(Rcpp::RawVector x, Rcpp::RObject columns, Rcpp::RObject rows);
+RcppExport SEXP _protolite_cpp_unserialize_pb_slice(SEXP xSEXP, SEXP columnsSEXP, SEXP rowsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type x(xSEXP);
+    Rcpp::traits::input_parameter< Rcpp::RObject >::type columns(columnsSEXP);
+    Rcpp::traits::input_parameter< Rcpp::RObject >::type rows(rowsSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_unserialize_pb_slice(x, columns, rows));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_stats_enable
+bool cpp_stats_enable(bool enable);
+RcppExport SEXP _protolite_cpp_stats_enable(SEXP enableSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< bool >::type enable(enableSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_stats_enable(enable));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_stats_reset
+void cpp_stats_reset();
+RcppExport SEXP _protolite_cpp_stats_reset() {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    cpp_stats_reset();
+    return R_NilValue;
+END_RCPP
+}
+// cpp_stats_get
+Rcpp::List cpp_stats_get();
+RcppExport SEXP _protolite_cpp_stats_get() {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    rcpp_result_gen = Rcpp::wrap(cpp_stats_get());
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_geobuf2mvt
+Rcpp::RawVector cpp_geobuf2mvt(Rcpp::RawVector x, Rcpp::NumericVector zxy, int extent, std::string name);
+RcppExport SEXP _protolite_cpp_geobuf2mvt(SEXP xSEXP, SEXP zxySEXP, SEXP extentSEXP, SEXP nameSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type x(xSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type zxy(zxySEXP);
+    Rcpp::traits::input_parameter< int >::type extent(extentSEXP);
+    Rcpp::traits::input_parameter< std::string >::type name(nameSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_geobuf2mvt(x, zxy, extent, name));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_mvt2geobuf
+Rcpp::RawVector cpp_mvt2geobuf(Rcpp::RawVector x, Rcpp::NumericVector zxy, int precision, std::vector<std::string> layers);
+RcppExport SEXP _protolite_cpp_mvt2geobuf(SEXP xSEXP, SEXP zxySEXP, SEXP precisionSEXP, SEXP layersSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type x(xSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type zxy(zxySEXP);
+    Rcpp::traits::input_parameter< int >::type precision(precisionSEXP);
+    Rcpp::traits::input_parameter< std::vector<std::string> >::type layers(layersSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_mvt2geobuf(x, zxy, precision, layers));
     return rcpp_result_gen;
 END_RCPP
 }
 // cpp_unserialize_geobuf
-List cpp_unserialize_geobuf(Rcpp::RawVector x);
-RcppExport SEXP _protolite_cpp_unserialize_geobuf(SEXP xSEXP) {
+Rcpp::RObject cpp_unserialize_geobuf(Rcpp::RawVector x, double tol, bool wkb);
+RcppExport SEXP _protolite_cpp_unserialize_geobuf(SEXP xSEXP, SEXP tolSEXP, SEXP wkbSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type x(xSEXP);
+    Rcpp::traits::input_parameter< double >::type tol(tolSEXP);
+    Rcpp::traits::input_parameter< bool >::type wkb(wkbSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_unserialize_geobuf(x, tol, wkb));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_unserialize_geobuf_wire
+Rcpp::RObject cpp_unserialize_geobuf_wire(Rcpp::RawVector x, double tol, bool wkb);
+RcppExport SEXP _protolite_cpp_unserialize_geobuf_wire(SEXP xSEXP, SEXP tolSEXP, SEXP wkbSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type x(xSEXP);
+    Rcpp::traits::input_parameter< double >::type tol(tolSEXP);
+    Rcpp::traits::input_parameter< bool >::type wkb(wkbSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_unserialize_geobuf_wire(x, tol, wkb));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_unserialize_geobuf_features
+List cpp_unserialize_geobuf_features(Rcpp::RawVector x, Rcpp::IntegerVector features, double tol, bool wkb);
+RcppExport SEXP _protolite_cpp_unserialize_geobuf_features(SEXP xSEXP, SEXP featuresSEXP, SEXP tolSEXP, SEXP wkbSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< Rcpp::RawVector >::type x(xSEXP);
-    rcpp_result_gen = Rcpp::wrap(cpp_unserialize_geobuf(x));
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type features(featuresSEXP);
+    Rcpp::traits::input_parameter< double >::type tol(tolSEXP);
+    Rcpp::traits::input_parameter< bool >::type wkb(wkbSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_unserialize_geobuf_features(x, features, tol, wkb));
     return rcpp_result_gen;
 END_RCPP
 }
+// cpp_geobuf_arrow
+void cpp_geobuf_arrow(Rcpp::RawVector x, SEXP schema, SEXP array);
+RcppExport SEXP _protolite_cpp_geobuf_arrow(SEXP xSEXP, SEXP schemaSEXP, SEXP arraySEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type x(xSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type schema(schemaSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type array(arraySEXP);
+    cpp_geobuf_arrow(x, schema, array);
+    return R_NilValue;
+END_RCPP
+}
 // cpp_unserialize_mvt
 Rcpp::List cpp_unserialize_mvt(Rcpp::RawVector x);
 RcppExport SEXP _protolite_cpp_unserialize_mvt(SEXP xSEXP) {
@@ -65,6 +343,57 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// cpp_unserialize_mvt_wire
+Rcpp::List cpp_unserialize_mvt_wire(Rcpp::RawVector x);
+RcppExport SEXP _protolite_cpp_unserialize_mvt_wire(SEXP xSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type x(xSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_unserialize_mvt_wire(x));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_unserialize_mvt_wkb
+Rcpp::List cpp_unserialize_mvt_wkb(Rcpp::RawVector x, Rcpp::NumericVector zxy, bool as_latlon, bool wire);
+RcppExport SEXP _protolite_cpp_unserialize_mvt_wkb(SEXP xSEXP, SEXP zxySEXP, SEXP as_latlonSEXP, SEXP wireSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type x(xSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type zxy(zxySEXP);
+    Rcpp::traits::input_parameter< bool >::type as_latlon(as_latlonSEXP);
+    Rcpp::traits::input_parameter< bool >::type wire(wireSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_unserialize_mvt_wkb(x, zxy, as_latlon, wire));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_mvt_layer_names
+std::vector<std::string> cpp_mvt_layer_names(Rcpp::RawVector x);
+RcppExport SEXP _protolite_cpp_mvt_layer_names(SEXP xSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type x(xSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_mvt_layer_names(x));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cpp_mvt_arrow
+void cpp_mvt_arrow(Rcpp::RawVector x, Rcpp::NumericVector zxy, bool as_latlon, bool wire, Rcpp::List schemas, Rcpp::List arrays);
+RcppExport SEXP _protolite_cpp_mvt_arrow(SEXP xSEXP, SEXP zxySEXP, SEXP as_latlonSEXP, SEXP wireSEXP, SEXP schemasSEXP, SEXP arraysSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type x(xSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type zxy(zxySEXP);
+    Rcpp::traits::input_parameter< bool >::type as_latlon(as_latlonSEXP);
+    Rcpp::traits::input_parameter< bool >::type wire(wireSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type schemas(schemasSEXP);
+    Rcpp::traits::input_parameter< Rcpp::List >::type arrays(arraysSEXP);
+    cpp_mvt_arrow(x, zxy, as_latlon, wire, schemas, arrays);
+    return R_NilValue;
+END_RCPP
+}
 // cpp_unserialize_pb
 Rcpp::RObject cpp_unserialize_pb(Rcpp::RawVector x);
 RcppExport SEXP _protolite_cpp_unserialize_pb(SEXP xSEXP) {
@@ -76,14 +405,53 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// cpp_unserialize_pb_wire
+Rcpp::RObject cpp_unserialize_pb_wire(Rcpp::RawVector x);
+RcppExport SEXP _protolite_cpp_unserialize_pb_wire(SEXP xSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type x(xSEXP);
+    rcpp_result_gen = Rcpp::wrap(cpp_unserialize_pb_wire(x));
+    return rcpp_result_gen;
+END_RCPP
+}
 
 static const R_CallMethodDef CallEntries[] = {
+    {"_protolite_cpp_unserialize_pb_batch", (DL_FUNC) &_protolite_cpp_unserialize_pb_batch, 3},
+    {"_protolite_cpp_mvt_cache_enabled", (DL_FUNC) &_protolite_cpp_mvt_cache_enabled, 0},
+    {"_protolite_cpp_mvt_cache_key", (DL_FUNC) &_protolite_cpp_mvt_cache_key, 4},
+    {"_protolite_cpp_mvt_cache_get", (DL_FUNC) &_protolite_cpp_mvt_cache_get, 2},
+    {"_protolite_cpp_mvt_cache_put", (DL_FUNC) &_protolite_cpp_mvt_cache_put, 3},
+    {"_protolite_cpp_mvt_cache_config", (DL_FUNC) &_protolite_cpp_mvt_cache_config, 2},
+    {"_protolite_cpp_serialize_pb_chunked", (DL_FUNC) &_protolite_cpp_serialize_pb_chunked, 4},
+    {"_protolite_cpp_is_chunked", (DL_FUNC) &_protolite_cpp_is_chunked, 1},
+    {"_protolite_cpp_unserialize_pb_chunked", (DL_FUNC) &_protolite_cpp_unserialize_pb_chunked, 1},
     {"_protolite_cpp_serialize_geobuf", (DL_FUNC) &_protolite_cpp_serialize_geobuf, 2},
+    {"_protolite_cpp_hash_pb", (DL_FUNC) &_protolite_cpp_hash_pb, 2},
+    {"_protolite_cpp_hash_raw", (DL_FUNC) &_protolite_cpp_hash_raw, 1},
     {"_protolite_R_start_protobuf", (DL_FUNC) &_protolite_R_start_protobuf, 0},
-    {"_protolite_cpp_serialize_pb", (DL_FUNC) &_protolite_cpp_serialize_pb, 2},
-    {"_protolite_cpp_unserialize_geobuf", (DL_FUNC) &_protolite_cpp_unserialize_geobuf, 1},
+    {"_protolite_cpp_inspect_geobuf", (DL_FUNC) &_protolite_cpp_inspect_geobuf, 1},
+    {"_protolite_cpp_inspect_mvt", (DL_FUNC) &_protolite_cpp_inspect_mvt, 1},
+    {"_protolite_cpp_kernel_select", (DL_FUNC) &_protolite_cpp_kernel_select, 1},
+    {"_protolite_cpp_serialize_pb", (DL_FUNC) &_protolite_cpp_serialize_pb, 3},
+    {"_protolite_cpp_unserialize_pb_slice", (DL_FUNC) &_protolite_cpp_unserialize_pb_slice, 3},
+    {"_protolite_cpp_stats_enable", (DL_FUNC) &_protolite_cpp_stats_enable, 1},
+    {"_protolite_cpp_stats_reset", (DL_FUNC) &_protolite_cpp_stats_reset, 0},
+    {"_protolite_cpp_stats_get", (DL_FUNC) &_protolite_cpp_stats_get, 0},
+    {"_protolite_cpp_geobuf2mvt", (DL_FUNC) &_protolite_cpp_geobuf2mvt, 4},
+    {"_protolite_cpp_mvt2geobuf", (DL_FUNC) &_protolite_cpp_mvt2geobuf, 4},
+    {"_protolite_cpp_unserialize_geobuf", (DL_FUNC) &_protolite_cpp_unserialize_geobuf, 3},
+    {"_protolite_cpp_unserialize_geobuf_wire", (DL_FUNC) &_protolite_cpp_unserialize_geobuf_wire, 3},
+    {"_protolite_cpp_unserialize_geobuf_features", (DL_FUNC) &_protolite_cpp_unserialize_geobuf_features, 4},
+    {"_protolite_cpp_geobuf_arrow", (DL_FUNC) &_protolite_cpp_geobuf_arrow, 3},
     {"_protolite_cpp_unserialize_mvt", (DL_FUNC) &_protolite_cpp_unserialize_mvt, 1},
+    {"_protolite_cpp_unserialize_mvt_wire", (DL_FUNC) &_protolite_cpp_unserialize_mvt_wire, 1},
+    {"_protolite_cpp_unserialize_mvt_wkb", (DL_FUNC) &_protolite_cpp_unserialize_mvt_wkb, 4},
+    {"_protolite_cpp_mvt_layer_names", (DL_FUNC) &_protolite_cpp_mvt_layer_names, 1},
+    {"_protolite_cpp_mvt_arrow", (DL_FUNC) &_protolite_cpp_mvt_arrow, 6},
     {"_protolite_cpp_unserialize_pb", (DL_FUNC) &_protolite_cpp_unserialize_pb, 1},
+    {"_protolite_cpp_unserialize_pb_wire", (DL_FUNC) &_protolite_cpp_unserialize_pb_wire, 1},
     {NULL, NULL, 0}
 };
 
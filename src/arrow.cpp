@@ -0,0 +1,283 @@
+#include "arrow.h"
+#include <Rcpp.h>
+#include <stdexcept>
+#include <string.h>
+#include <climits>
+#include <cstdio>
+
+arrow_column::arrow_column(const std::string &name, const std::string &format, const std::string &metadata) :
+  name(name), format(format), metadata(metadata), length(0), null_count(0) {
+  if(format == "u" || format == "z")
+    offsets.push_back(0);
+}
+
+void arrow_column::valid(bool is_valid){
+  if(length % 8 == 0)
+    validity.push_back(0);
+  if(is_valid){
+    validity.back() |= 1 << (length % 8);
+  } else {
+    null_count++;
+  }
+}
+
+void arrow_column::append_fixed(const void *data, size_t size){
+  values.insert(values.end(), (const uint8_t*) data, (const uint8_t*) data + size);
+}
+
+void arrow_column::append_null(){
+  if(format == "b"){
+    if(length % 8 == 0)
+      values.push_back(0);
+  } else if(offsets.size()){
+    offsets.push_back(offsets.back());
+  } else {
+    values.resize(values.size() + 8);
+  }
+  valid(false);
+  length++;
+}
+
+void arrow_column::append_bool(bool val){
+  if(length % 8 == 0)
+    values.push_back(0);
+  if(val)
+    values.back() |= 1 << (length % 8);
+  valid(true);
+  length++;
+}
+
+void arrow_column::append_int64(int64_t val){
+  append_fixed(&val, sizeof(val));
+  valid(true);
+  length++;
+}
+
+void arrow_column::append_uint64(uint64_t val){
+  append_fixed(&val, sizeof(val));
+  valid(true);
+  length++;
+}
+
+void arrow_column::append_double(double val){
+  append_fixed(&val, sizeof(val));
+  valid(true);
+  length++;
+}
+
+void arrow_column::append_bytes(const void *data, size_t size){
+  if(values.size() + size > INT_MAX)
+    throw std::runtime_error("Column '" + name + "' exceeds the 2GB limit of an arrow array");
+  append_fixed(data, size);
+  offsets.push_back(values.size());
+  valid(true);
+  length++;
+}
+
+std::string arrow_format(int kinds){
+  if(kinds == ARROW_BOOL)
+    return "b";
+  if(kinds == ARROW_INT)
+    return "l";
+  if(kinds && !(kinds & ~(ARROW_INT | ARROW_DOUBLE)))
+    return "g";
+  return "u";
+}
+
+void arrow_append(arrow_column &column, const arrow_value &val){
+  if(column.format == "b"){
+    column.append_bool(val.b);
+  } else if(column.format == "l"){
+    column.append_int64(val.i);
+  } else if(column.format == "g"){
+    column.append_double(val.kind == ARROW_INT ? (double) val.i : val.d);
+  } else if(val.kind == ARROW_STRING){
+    column.append_bytes(val.s.data(), val.s.size());
+  } else {
+    char buf[32];
+    if(val.kind == ARROW_BOOL){
+      snprintf(buf, sizeof(buf), "%s", val.b ? "true" : "false");
+    } else if(val.kind == ARROW_INT){
+      snprintf(buf, sizeof(buf), "%lld", (long long) val.i);
+    } else {
+      snprintf(buf, sizeof(buf), "%.15g", val.d);
+    }
+    column.append_bytes(buf, strlen(buf));
+  }
+}
+
+static bool arrow_has_column(const std::vector<arrow_column> &columns, const std::string &name){
+  for(size_t i = 0; i < columns.size(); i++){
+    if(columns[i].name == name)
+      return true;
+  }
+  return false;
+}
+
+// Prefixes a key that is already used by another column, e.g. a property named 'id'
+static std::string arrow_unique_name(const std::vector<arrow_column> &columns, std::string name){
+  while(arrow_has_column(columns, name))
+    name = "properties." + name;
+  return name;
+}
+
+void arrow_properties(std::vector<arrow_column> &columns, const std::vector<std::string> &keys,
+                      const std::vector<arrow_row> &rows){
+  std::vector<int> kinds(keys.size());
+  for(size_t r = 0; r < rows.size(); r++){
+    for(size_t j = 0; j < rows[r].size(); j++){
+      if(rows[r][j].first >= keys.size())
+        throw std::runtime_error("Property key index out of bounds");
+      kinds[rows[r][j].first] |= rows[r][j].second.kind;
+    }
+  }
+  size_t first = columns.size();
+  for(size_t k = 0; k < keys.size(); k++)
+    columns.push_back(arrow_column(arrow_unique_name(columns, keys[k]), arrow_format(kinds[k])));
+  for(size_t r = 0; r < rows.size(); r++){
+    for(size_t j = 0; j < rows[r].size(); j++){
+      arrow_column &column = columns[first + rows[r][j].first];
+      if(column.length == (int64_t) r && rows[r][j].second.kind)
+        arrow_append(column, rows[r][j].second);
+    }
+    for(size_t k = first; k < columns.size(); k++){
+      if(columns[k].length == (int64_t) r)
+        columns[k].append_null();
+    }
+  }
+}
+
+static void append_int32(std::string &out, int32_t val){
+  out.append((const char*) &val, sizeof(val));
+}
+
+std::string arrow_metadata(const std::vector<std::pair<std::string, std::string>> &pairs){
+  std::string out;
+  append_int32(out, pairs.size());
+  for(size_t i = 0; i < pairs.size(); i++){
+    append_int32(out, pairs[i].first.size());
+    out.append(pairs[i].first);
+    append_int32(out, pairs[i].second.size());
+    out.append(pairs[i].second);
+  }
+  return out;
+}
+
+// Owners of the strings and children of an exported schema
+struct schema_private {
+  std::string format;
+  std::string name;
+  std::string metadata;
+  std::vector<ArrowSchema*> children;
+};
+
+// Owners of the buffers and children of an exported array
+struct array_private {
+  std::vector<std::vector<uint8_t>> data;
+  std::vector<std::vector<int32_t>> offsets;
+  std::vector<const void*> buffers;
+  std::vector<ArrowArray*> children;
+};
+
+static void release_schema(ArrowSchema *schema){
+  schema_private *priv = (schema_private*) schema->private_data;
+  for(size_t i = 0; i < priv->children.size(); i++){
+    if(priv->children[i]->release)
+      priv->children[i]->release(priv->children[i]);
+    delete priv->children[i];
+  }
+  delete priv;
+  schema->release = NULL;
+}
+
+static void release_array(ArrowArray *array){
+  array_private *priv = (array_private*) array->private_data;
+  for(size_t i = 0; i < priv->children.size(); i++){
+    if(priv->children[i]->release)
+      priv->children[i]->release(priv->children[i]);
+    delete priv->children[i];
+  }
+  delete priv;
+  array->release = NULL;
+}
+
+static void init_schema(ArrowSchema *schema, schema_private *priv, int64_t flags){
+  schema->format = priv->format.c_str();
+  schema->name = priv->name.c_str();
+  schema->metadata = priv->metadata.size() ? priv->metadata.data() : NULL;
+  schema->flags = flags;
+  schema->n_children = priv->children.size();
+  schema->children = priv->children.size() ? priv->children.data() : NULL;
+  schema->dictionary = NULL;
+  schema->release = release_schema;
+  schema->private_data = priv;
+}
+
+static void init_array(ArrowArray *array, array_private *priv, int64_t length, int64_t null_count){
+  array->length = length;
+  array->null_count = null_count;
+  array->offset = 0;
+  array->n_buffers = priv->buffers.size();
+  array->buffers = priv->buffers.data();
+  array->n_children = priv->children.size();
+  array->children = priv->children.size() ? priv->children.data() : NULL;
+  array->dictionary = NULL;
+  array->release = release_array;
+  array->private_data = priv;
+}
+
+// The buffers are moved into the private data first, such that their
+// addresses do not change anymore.
+static void export_column(arrow_column &column, ArrowSchema *schema, ArrowArray *array){
+  schema_private *spriv = new schema_private;
+  spriv->format = column.format;
+  spriv->name = column.name;
+  spriv->metadata = column.metadata;
+  init_schema(schema, spriv, ARROW_FLAG_NULLABLE);
+
+  array_private *apriv = new array_private;
+  apriv->data.resize(2);
+  apriv->data[0].swap(column.validity);
+  apriv->data[1].swap(column.values);
+  apriv->data[1].reserve(8);
+  apriv->buffers.push_back(column.null_count ? apriv->data[0].data() : NULL);
+  if(column.offsets.size()){
+    apriv->offsets.resize(1);
+    apriv->offsets[0].swap(column.offsets);
+    apriv->buffers.push_back(apriv->offsets[0].data());
+  }
+  apriv->buffers.push_back(apriv->data[1].data());
+  init_array(array, apriv, column.length, column.null_count);
+}
+
+void arrow_export(std::vector<arrow_column> &columns, int64_t length, ArrowSchema *schema, ArrowArray *array){
+  for(size_t i = 0; i < columns.size(); i++){
+    if(columns[i].length != length)
+      throw std::runtime_error("Column '" + columns[i].name + "' does not have the number of rows");
+  }
+  schema_private *spriv = new schema_private;
+  spriv->format = "+s";
+  array_private *apriv = new array_private;
+  apriv->buffers.push_back(NULL);
+  for(size_t i = 0; i < columns.size(); i++){
+    spriv->children.push_back(new ArrowSchema());
+    apriv->children.push_back(new ArrowArray());
+    export_column(columns[i], spriv->children.back(), apriv->children.back());
+  }
+  init_schema(schema, spriv, 0);
+  init_array(array, apriv, length, 0);
+}
+
+ArrowSchema *arrow_schema_xptr(SEXP x){
+  ArrowSchema *schema = TYPEOF(x) == EXTPTRSXP ? (ArrowSchema*) R_ExternalPtrAddr(x) : NULL;
+  if(!schema || schema->release)
+    throw std::runtime_error("Expected an empty nanoarrow_schema");
+  return schema;
+}
+
+ArrowArray *arrow_array_xptr(SEXP x){
+  ArrowArray *array = TYPEOF(x) == EXTPTRSXP ? (ArrowArray*) R_ExternalPtrAddr(x) : NULL;
+  if(!array || array->release)
+    throw std::runtime_error("Expected an empty nanoarrow_array");
+  return array;
+}
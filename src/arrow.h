@@ -0,0 +1,111 @@
+#ifndef PROTOLITE_ARROW_H
+#define PROTOLITE_ARROW_H
+
+// Builder for columns in the Arrow C data interface, used to export decoded
+// layers as a record batch (a struct array with one child per column). The
+// buffers are owned by the exported arrays, and freed by their release callback.
+// See https://arrow.apache.org/docs/format/CDataInterface.html
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+  void (*release)(struct ArrowSchema*);
+  void* private_data;
+};
+
+struct ArrowArray {
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+  void (*release)(struct ArrowArray*);
+  void* private_data;
+};
+
+#endif
+
+class arrow_column {
+public:
+  std::string name;
+  std::string format;   // "b" (bool), "l" (int64), "L" (uint64), "g" (double), "u" (utf8) or "z" (binary)
+  std::string metadata; // encoded key/value pairs, see arrow_metadata()
+  int64_t length;
+  int64_t null_count;
+  std::vector<uint8_t> validity;
+  std::vector<uint8_t> values;
+  std::vector<int32_t> offsets;
+
+  arrow_column(const std::string &name, const std::string &format, const std::string &metadata = "");
+  void append_null();
+  void append_bool(bool val);
+  void append_int64(int64_t val);
+  void append_uint64(uint64_t val);
+  void append_double(double val);
+  void append_bytes(const void *data, size_t size);
+
+private:
+  void valid(bool is_valid);
+  void append_fixed(const void *data, size_t size);
+};
+
+// A property value, with the kind of value to choose the type of the column
+enum { ARROW_BOOL = 1, ARROW_INT = 2, ARROW_DOUBLE = 4, ARROW_STRING = 8 };
+
+struct arrow_value {
+  int kind;
+  bool b;
+  int64_t i;
+  double d;
+  std::string s;
+};
+
+// Properties of a row, as pairs of the key index and the value
+typedef std::vector<std::pair<uint32_t, arrow_value>> arrow_row;
+
+// Format of a column that has values of the given kinds (bitwise or). Numbers are
+// stored as int64 or double, and columns with mixed kinds as strings.
+std::string arrow_format(int kinds);
+
+// Appends a value to a column with the format from arrow_format()
+void arrow_append(arrow_column &column, const arrow_value &val);
+
+// Adds a column for each key with the properties of the rows. Values are null
+// for rows without the key, and only the first value is used for duplicate keys.
+// Keys that clash with an existing column name get a "properties." prefix.
+void arrow_properties(std::vector<arrow_column> &columns, const std::vector<std::string> &keys,
+                      const std::vector<arrow_row> &rows);
+
+// Encodes key/value pairs in the binary format of the schema metadata
+std::string arrow_metadata(const std::vector<std::pair<std::string, std::string>> &pairs);
+
+// The structs of the external pointers from nanoarrow_allocate_schema() and
+// nanoarrow_allocate_array(), which must be empty (released)
+typedef struct SEXPREC *SEXP;
+ArrowSchema *arrow_schema_xptr(SEXP x);
+ArrowArray *arrow_array_xptr(SEXP x);
+
+// Moves the columns into a struct array with 'length' rows
+void arrow_export(std::vector<arrow_column> &columns, int64_t length, ArrowSchema *schema, ArrowArray *array);
+
+#endif
@@ -0,0 +1,98 @@
+#include "rexp.pb.h"
+#include "stats.h"
+#include <Rcpp.h>
+#include <google/protobuf/arena.h>
+#include <atomic>
+#include <climits>
+#include <thread>
+
+// Unserialize many small messages at once. All messages are parsed into a
+// single arena by a pool of threads, and then converted into R objects on the
+// main thread (the R API is not thread safe). Segmented messages, and all
+// messages when the wire decoder is used, are decoded on the main thread.
+
+//from unserialize.cpp
+Rcpp::RObject unrexp_object(const rexp::REXP &message);
+Rcpp::RObject cpp_unserialize_pb_wire(Rcpp::RawVector x);
+
+//from chunked.cpp
+bool cpp_is_chunked(Rcpp::RawVector x);
+Rcpp::RObject cpp_unserialize_pb_chunked(Rcpp::RawVector x);
+
+static std::string batch_error(size_t i){
+  return "Failed to parse protobuf message " + std::to_string(i + 1);
+}
+
+// [[Rcpp::export]]
+Rcpp::List cpp_unserialize_pb_batch(Rcpp::List x, int threads, bool wire){
+  size_t n = x.size();
+  std::vector<const Rbyte *> data(n);
+  std::vector<size_t> sizes(n);
+  std::vector<char> serial(n, wire);
+  size_t total = 0;
+  for(size_t i = 0; i < n; i++){
+    SEXP el = x[i];
+    if(TYPEOF(el) != RAWSXP)
+      throw std::runtime_error("All elements must be raw vectors");
+    if(XLENGTH(el) > INT_MAX)
+      throw std::runtime_error("Message too large for batch mode, use unserialize_pb()");
+    data[i] = RAW(el);
+    sizes[i] = XLENGTH(el);
+    serial[i] = serial[i] || cpp_is_chunked(el);
+    total += sizes[i];
+  }
+  stats_call stats("cpp_unserialize_pb_batch", total);
+
+  // Blocks grow up to 1MB so that large batches need few allocations
+  google::protobuf::ArenaOptions options;
+  options.max_block_size = 1 << 20;
+  google::protobuf::Arena arena(options);
+  std::vector<rexp::REXP*> messages(n);
+  for(size_t i = 0; i < n; i++){
+    if(!serial[i])
+      messages[i] = google::protobuf::Arena::CreateMessage<rexp::REXP>(&arena);
+  }
+
+  std::vector<char> success(n, 0);
+  std::atomic<size_t> next(0);
+  auto worker = [&](){
+    size_t i;
+    while((i = next++) < n){
+      if(serial[i])
+        continue;
+      try {
+        success[i] = messages[i]->ParseFromArray(data[i], sizes[i]);
+      } catch(...) {
+        success[i] = 0;
+      }
+    }
+  };
+  {
+    stats_phase phase(PHASE_PARSE);
+    size_t nthreads = wire ? 1 : std::min((size_t) std::max(threads, 1), n);
+    std::vector<std::thread> pool;
+    for(size_t t = 1; t < nthreads; t++)
+      pool.push_back(std::thread(worker));
+    worker();
+    for(size_t t = 0; t < pool.size(); t++)
+      pool[t].join();
+  }
+
+  stats_phase phase(PHASE_MATERIALIZE);
+  Rcpp::List out(n);
+  for(size_t i = 0; i < n; i++){
+    if(serial[i]){
+      try {
+        Rcpp::RawVector el = x[i];
+        out[i] = cpp_is_chunked(el) ? cpp_unserialize_pb_chunked(el) : cpp_unserialize_pb_wire(el);
+      } catch(std::exception &e) {
+        throw std::runtime_error(batch_error(i) + ": " + e.what());
+      }
+    } else if(!success[i]){
+      throw std::runtime_error(batch_error(i));
+    } else {
+      out[i] = unrexp_object(*messages[i]);
+    }
+  }
+  return out;
+}
@@ -0,0 +1,148 @@
+#include "xxhash.h"
+#include <Rcpp.h>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <unordered_map>
+
+// LRU cache of decoded tiles for read_mvt_data(). Entries are keyed by a hash
+// of the tile content plus the parameters that affect the output (zxy is used
+// by both projections). The hash is not collision resistant, so each entry also
+// keeps the raw tile, which is compared on every hit. The cache is bounded by
+// the (estimated) size of the tiles and R objects, and disabled by default.
+
+struct cache_entry {
+  std::string key;
+  std::string data;
+  SEXP value;
+  size_t bytes;
+};
+
+typedef std::list<cache_entry> cache_list;
+
+static cache_list lru; // most recently used first
+static std::unordered_map<std::string, cache_list::iterator> entries;
+static size_t max_bytes = 0;
+static size_t total_bytes = 0;
+static double hits = 0;
+static double misses = 0;
+static double evictions = 0;
+
+// Approximate memory use of an R object, similar to utils::object.size()
+static size_t object_bytes(SEXP x){
+  size_t size = 56;
+  switch(TYPEOF(x)){
+  case NILSXP:
+    return 0;
+  case LGLSXP:
+  case INTSXP:
+    size += Rf_xlength(x) * sizeof(int);
+    break;
+  case REALSXP:
+    size += Rf_xlength(x) * sizeof(double);
+    break;
+  case CPLXSXP:
+    size += Rf_xlength(x) * sizeof(Rcomplex);
+    break;
+  case RAWSXP:
+    size += Rf_xlength(x);
+    break;
+  case STRSXP:
+    size += Rf_xlength(x) * sizeof(SEXP);
+    for(R_xlen_t i = 0; i < Rf_xlength(x); i++)
+      size += 56 + LENGTH(STRING_ELT(x, i));
+    break;
+  case VECSXP:
+    size += Rf_xlength(x) * sizeof(SEXP);
+    for(R_xlen_t i = 0; i < Rf_xlength(x); i++)
+      size += object_bytes(VECTOR_ELT(x, i));
+    break;
+  case LISTSXP:
+    return size + object_bytes(CAR(x)) + object_bytes(CDR(x));
+  }
+  return size + object_bytes(ATTRIB(x));
+}
+
+static void cache_evict(size_t limit){
+  while(total_bytes > limit && lru.size()){
+    cache_entry &last = lru.back();
+    R_ReleaseObject(last.value);
+    total_bytes -= last.bytes;
+    entries.erase(last.key);
+    lru.pop_back();
+    evictions++;
+  }
+}
+
+// [[Rcpp::export]]
+bool cpp_mvt_cache_enabled(){
+  return max_bytes > 0;
+}
+
+// [[Rcpp::export]]
+std::string cpp_mvt_cache_key(Rcpp::RawVector data, Rcpp::NumericVector zxy, bool as_latlon, bool wkb){
+  if(zxy.size() != 3)
+    throw std::runtime_error("zxy must have length 3");
+  char buf[100];
+  snprintf(buf, sizeof(buf), "%016llx:%.0f:%.0f/%.0f/%.0f:%d:%d",
+           (unsigned long long) xxh64_hash(data.begin(), data.size()), (double) data.size(),
+           zxy[0], zxy[1], zxy[2], (int) as_latlon, (int) wkb);
+  return buf;
+}
+
+// Guards against hash collisions of different tiles
+static bool cache_match(const cache_entry &entry, Rcpp::RawVector data){
+  return entry.data.size() == (size_t) data.size() && !memcmp(entry.data.data(), data.begin(), data.size());
+}
+
+// [[Rcpp::export]]
+SEXP cpp_mvt_cache_get(std::string key, Rcpp::RawVector data){
+  std::unordered_map<std::string, cache_list::iterator>::iterator it = entries.find(key);
+  if(it == entries.end() || !cache_match(*it->second, data)){
+    misses++;
+    return R_NilValue;
+  }
+  hits++;
+  lru.splice(lru.begin(), lru, it->second);
+  return it->second->value;
+}
+
+// [[Rcpp::export]]
+void cpp_mvt_cache_put(std::string key, Rcpp::RawVector data, SEXP value){
+  size_t bytes = object_bytes(value) + key.size() + data.size();
+  if(bytes > max_bytes || entries.count(key))
+    return;
+  // Callers get the cached object itself, so modifications must copy
+  MARK_NOT_MUTABLE(value);
+  R_PreserveObject(value);
+  cache_entry entry = {key, std::string((const char*) data.begin(), data.size()), value, bytes};
+  lru.push_front(entry);
+  entries[key] = lru.begin();
+  total_bytes += bytes;
+  cache_evict(max_bytes);
+}
+
+// [[Rcpp::export]]
+Rcpp::List cpp_mvt_cache_config(double size, bool clear){
+  if(clear){
+    for(cache_list::iterator it = lru.begin(); it != lru.end(); it++)
+      R_ReleaseObject(it->value);
+    lru.clear();
+    entries.clear();
+    total_bytes = 0;
+    hits = misses = evictions = 0;
+  }
+  // A negative size keeps the current setting
+  if(size >= 0){
+    max_bytes = size;
+    cache_evict(max_bytes);
+  }
+  return Rcpp::List::create(
+    Rcpp::_["max_bytes"] = (double) max_bytes,
+    Rcpp::_["bytes"] = (double) total_bytes,
+    Rcpp::_["entries"] = (double) lru.size(),
+    Rcpp::_["hits"] = hits,
+    Rcpp::_["misses"] = misses,
+    Rcpp::_["evictions"] = evictions
+  );
+}
@@ -0,0 +1,329 @@
+#include "rexp.pb.h"
+#include "stats.h"
+#include "wire.h"
+#include <Rcpp.h>
+#include <climits>
+#include <cstring>
+#include <unordered_map>
+
+/* Container for objects that exceed the 2GB limit of a single protobuf message.
+ * The output starts with an 8 byte header, followed by a sequence of records,
+ * each a varint with the size and a regular REXP message of at most 2GB.
+ *
+ * Objects that fit within the segment size are stored as a single record. For
+ * larger objects, the first record is a header REXP with the rclass, the total
+ * length, the number of 'chunks' that follow and the attribute names. For atomic
+ * vectors the chunks are REXP records with consecutive slices of the values. For
+ * lists each chunk is the (possibly chunked) object of one of the elements. After
+ * the chunks follows one (possibly chunked) object per attribute value. */
+
+static const uint8_t chunk_magic[8] = {0x00, 'R', 'P', 'B', 'C', 0x01, 0x00, 0x00};
+
+//from serialize.cpp
+rexp::REXP rexp_object(Rcpp::RObject x, bool skip_native, bool compact);
+rexp::REXP rexp_vector(SEXP x, R_xlen_t from, R_xlen_t to, bool compact);
+
+//from unserialize.cpp
+Rcpp::RObject unrexp_object(const rexp::REXP &message);
+Rcpp::RObject unrexp_any(const rexp::REXP &message);
+
+// Upper bound of the encoded size per element of fixed width vectors
+static double rexp_width(SEXP x, bool compact){
+  switch(TYPEOF(x)){
+  case LGLSXP: return compact ? 0.25 : 2;
+  case INTSXP: return 5;
+  case REALSXP: return 8;
+  case CPLXSXP: return 20;
+  case RAWSXP: return 1;
+  default: return 0;
+  }
+}
+
+// Upper bound of the encoded size of a string element, which is stored as UTF-8
+static double rexp_string_size(SEXP x){
+  return strlen(Rf_translateCharUTF8(x)) + 16.0;
+}
+
+static rexp::REXP_RClass rexp_chunk_class(SEXP x, bool compact){
+  switch(TYPEOF(x)){
+  case LGLSXP: return compact ? rexp::REXP_RClass_LOGICALBITS : rexp::REXP_RClass_LOGICAL;
+  case INTSXP: return rexp::REXP_RClass_INTEGER;
+  case REALSXP: return rexp::REXP_RClass_REAL;
+  case CPLXSXP: return rexp::REXP_RClass_COMPLEX;
+  case STRSXP: return compact ? rexp::REXP_RClass_STRINGDICT : rexp::REXP_RClass_STRING;
+  case RAWSXP: return rexp::REXP_RClass_RAW;
+  default: return rexp::REXP_RClass_LIST;
+  }
+}
+
+// Writes the container into 'out', or only measures its size if 'out' is NULL.
+// The output can exceed 2GB, so it is sized first and then written in place.
+class chunk_writer {
+public:
+  size_t size;
+
+  chunk_writer(double segment_size, bool skip_native, bool compact, uint8_t *out = NULL, size_t capacity = 0) :
+    size(sizeof(chunk_magic)), segment_size(segment_size), skip_native(skip_native), compact(compact),
+    out(out), capacity(capacity) {
+    if(out)
+      memcpy(out, chunk_magic, sizeof(chunk_magic));
+  }
+
+  void object(SEXP x){
+    int type = TYPEOF(x);
+    bool splittable = type == LGLSXP || type == INTSXP || type == REALSXP || type == CPLXSXP ||
+      type == STRSXP || type == RAWSXP || type == VECSXP;
+    if(!splittable || size_bound(x) <= segment_size){
+      record(rexp_object(x, skip_native, compact));
+      return;
+    }
+    R_xlen_t len = Rf_xlength(x);
+    rexp::REXP header;
+    header.set_rclass(rexp_chunk_class(x, compact));
+    header.set_length(len);
+    for(SEXP attr = ATTRIB(x); attr != R_NilValue; attr = CDR(attr))
+      header.add_attrname(CHAR(PRINTNAME(TAG(attr))));
+    stats_items(1);
+    if(type == VECSXP){
+      header.set_chunks(len);
+      record(header);
+      for(R_xlen_t i = 0; i < len; i++)
+        object(VECTOR_ELT(x, i));
+    } else {
+      std::vector<R_xlen_t> offsets = slices(x);
+      header.set_chunks(offsets.size() - 1);
+      record(header);
+      for(size_t i = 1; i < offsets.size(); i++){
+        record(rexp_vector(x, offsets[i-1], offsets[i], compact));
+      }
+    }
+    for(SEXP attr = ATTRIB(x); attr != R_NilValue; attr = CDR(attr))
+      object(CAR(attr));
+  }
+
+private:
+  double segment_size;
+  bool skip_native;
+  bool compact;
+  uint8_t *out;
+  size_t capacity;
+  std::unordered_map<SEXP, double> bounds;
+
+  // Upper bound of the encoded size of an object. Native objects are unknown
+  // until they are serialized, these are always stored as a single record.
+  // Bounds of lists and strings are cached, so these are only traversed once.
+  double size_bound(SEXP x){
+    std::unordered_map<SEXP, double>::iterator it = bounds.find(x);
+    if(it != bounds.end())
+      return it->second;
+    double size = 16;
+    R_xlen_t len = Rf_xlength(x);
+    switch(TYPEOF(x)){
+    case LGLSXP:
+    case INTSXP:
+    case REALSXP:
+    case CPLXSXP:
+    case RAWSXP:
+      size += len * rexp_width(x, compact);
+      break;
+    case STRSXP:
+      for(R_xlen_t i = 0; i < len; i++)
+        size += rexp_string_size(STRING_ELT(x, i));
+      break;
+    case VECSXP:
+      for(R_xlen_t i = 0; i < len; i++)
+        size += size_bound(VECTOR_ELT(x, i)) + 16;
+      break;
+    default:
+      return size;
+    }
+    for(SEXP attr = ATTRIB(x); attr != R_NilValue; attr = CDR(attr))
+      size += LENGTH(PRINTNAME(TAG(attr))) + size_bound(CAR(attr)) + 32;
+    if(TYPEOF(x) == VECSXP || TYPEOF(x) == STRSXP)
+      bounds[x] = size;
+    return size;
+  }
+
+  // Element offsets of the slices that fit within the segment size
+  std::vector<R_xlen_t> slices(SEXP x){
+    R_xlen_t len = Rf_xlength(x);
+    std::vector<R_xlen_t> offsets(1, 0);
+    if(TYPEOF(x) == STRSXP){
+      double size = 0;
+      for(R_xlen_t i = 0; i < len; i++){
+        double elsize = rexp_string_size(STRING_ELT(x, i));
+        if(size > 0 && size + elsize > segment_size){
+          offsets.push_back(i);
+          size = 0;
+        }
+        size += elsize;
+      }
+    } else {
+      R_xlen_t step = std::max((R_xlen_t) (segment_size / rexp_width(x, compact)), (R_xlen_t) 1);
+      for(R_xlen_t i = step; i < len; i += step)
+        offsets.push_back(i);
+    }
+    offsets.push_back(len);
+    return offsets;
+  }
+
+  void record(const rexp::REXP &message){
+#ifdef USENEWAPI
+    size_t len = message.ByteSizeLong();
+#else
+    size_t len = message.ByteSize();
+#endif
+    if(len > INT_MAX)
+      throw std::runtime_error("Object exceeds the 2GB limit of a protobuf message and cannot be split");
+    size_t need = len + 1;
+    for(uint64_t val = len; val >= 0x80; val >>= 7)
+      need++;
+    if(out && size + need > capacity)
+      throw std::runtime_error("Object changed size during serialization");
+    for(uint64_t val = len; ; val >>= 7){
+      uint8_t byte = val < 0x80 ? val : (val & 0x7f) | 0x80;
+      if(out)
+        out[size] = byte;
+      size++;
+      if(val < 0x80)
+        break;
+    }
+    if(out && !message.SerializeToArray(out + size, len))
+      throw std::runtime_error("Failed to serialize into protobuf message");
+    size += len;
+  }
+};
+
+class chunk_reader {
+public:
+  chunk_reader(const uint8_t *data, size_t size) : in(data, size) {
+    if(size < sizeof(chunk_magic) || memcmp(data, chunk_magic, sizeof(chunk_magic)))
+      throw std::runtime_error("Invalid header of segmented protobuf message");
+    in.pos += sizeof(chunk_magic);
+  }
+
+  bool done(){
+    return in.done();
+  }
+
+  Rcpp::RObject object(){
+    rexp::REXP message;
+    record(message);
+    if(!message.has_chunks()){
+      return unrexp_object(message);
+    }
+    uint64_t chunks = message.chunks();
+    R_xlen_t len = message.length();
+    Rcpp::RObject out;
+    stats_items(1);
+    stats_est_alloc(1);
+    switch(message.rclass()){
+    case rexp::REXP_RClass_LIST: {
+      if(chunks != (uint64_t) len)
+        throw std::runtime_error("Number of list elements does not match length");
+      Rcpp::List list(len);
+      for(R_xlen_t i = 0; i < len; i++)
+        list[i] = object();
+      out = list;
+      break;
+    }
+    case rexp::REXP_RClass_REAL: out = slices(chunks, len, REALSXP); break;
+    case rexp::REXP_RClass_INTEGER: out = slices(chunks, len, INTSXP); break;
+    case rexp::REXP_RClass_LOGICAL: out = slices(chunks, len, LGLSXP); break;
+    case rexp::REXP_RClass_LOGICALBITS: out = slices(chunks, len, LGLSXP); break;
+    case rexp::REXP_RClass_COMPLEX: out = slices(chunks, len, CPLXSXP); break;
+    case rexp::REXP_RClass_STRING: out = slices(chunks, len, STRSXP); break;
+    case rexp::REXP_RClass_STRINGDICT: out = slices(chunks, len, STRSXP); break;
+    case rexp::REXP_RClass_RAW: out = slices(chunks, len, RAWSXP); break;
+    default: throw std::runtime_error("Unsupported rclass type for segmented object");
+    }
+    for(int i = 0; i < message.attrname_size(); i++){
+      Rcpp::RObject val = object();
+      out.attr(message.attrname(i)) = val;
+    }
+    return out;
+  }
+
+private:
+  wire_reader in;
+
+  void record(rexp::REXP &message){
+    uint64_t size = in.varint();
+    if(size > in.remaining() || size > INT_MAX)
+      throw std::runtime_error("Truncated segmented protobuf message");
+    if(!message.ParseFromArray(in.pos, size))
+      throw std::runtime_error("Failed to parse protobuf message");
+    in.pos += size;
+  }
+
+  // Concatenate the values of the next 'chunks' records
+  SEXP slices(uint64_t chunks, R_xlen_t len, SEXPTYPE type){
+    Rcpp::RObject out = Rf_allocVector(type, len);
+    R_xlen_t offset = 0;
+    for(uint64_t i = 0; i < chunks; i++){
+      rexp::REXP message;
+      record(message);
+      Rcpp::RObject val = unrexp_any(message);
+      R_xlen_t n = Rf_xlength(val);
+      if(TYPEOF(val) != (int) type || n > len - offset)
+        throw std::runtime_error("Chunk does not match segmented vector");
+      switch(type){
+      case STRSXP:
+        for(R_xlen_t j = 0; j < n; j++)
+          SET_STRING_ELT(out, offset + j, STRING_ELT(val, j));
+        break;
+      case REALSXP:
+        memcpy(REAL(out) + offset, REAL(val), n * sizeof(double));
+        break;
+      case INTSXP:
+        memcpy(INTEGER(out) + offset, INTEGER(val), n * sizeof(int));
+        break;
+      case LGLSXP:
+        memcpy(LOGICAL(out) + offset, LOGICAL(val), n * sizeof(int));
+        break;
+      case CPLXSXP:
+        memcpy(COMPLEX(out) + offset, COMPLEX(val), n * sizeof(Rcomplex));
+        break;
+      case RAWSXP:
+        memcpy(RAW(out) + offset, RAW(val), n);
+        break;
+      }
+      offset += n;
+    }
+    if(offset != len)
+      throw std::runtime_error("Chunks do not match length of segmented vector");
+    return out;
+  }
+};
+
+// [[Rcpp::export]]
+Rcpp::RawVector cpp_serialize_pb_chunked(Rcpp::RObject x, bool skip_native, bool compact, double segment_size){
+  stats_call stats("cpp_serialize_pb_chunked", 0);
+  stats_phase materialize(PHASE_MATERIALIZE);
+  chunk_writer measure(segment_size, skip_native, compact);
+  measure.object(x);
+  Rcpp::RawVector res(measure.size);
+  stats_bytes(measure.size);
+  stats_est_alloc(1);
+  chunk_writer writer(segment_size, skip_native, compact, res.begin(), res.size());
+  writer.object(x);
+  if(writer.size != measure.size)
+    throw std::runtime_error("Object changed size during serialization");
+  return res;
+}
+
+// [[Rcpp::export]]
+bool cpp_is_chunked(Rcpp::RawVector x){
+  return x.size() >= (R_xlen_t) sizeof(chunk_magic) && !memcmp(x.begin(), chunk_magic, sizeof(chunk_magic));
+}
+
+// [[Rcpp::export]]
+Rcpp::RObject cpp_unserialize_pb_chunked(Rcpp::RawVector x){
+  stats_call stats("cpp_unserialize_pb_chunked", x.size());
+  stats_phase materialize(PHASE_MATERIALIZE);
+  chunk_reader reader(x.begin(), x.size());
+  Rcpp::RObject out = reader.object();
+  if(!reader.done())
+    throw std::runtime_error("Trailing data after segmented protobuf message");
+  return out;
+}
@@ -1,4 +1,6 @@
 #include "geobuf.pb.h"
+#include "stats.h"
+#include "wkb.h"
 #include <Rcpp.h>
 
 //shothands
@@ -54,6 +56,7 @@ Value make_value(Rcpp::RObject x){
     }
   }
   //default is to use JSON
+  stats_phase phase(PHASE_CALLBACK);
   Rcpp::Function make_json = Rcpp::Environment::namespace_env("protolite")["make_json"];
   Rcpp::CharacterVector json = make_json(x);
   out.set_json_value(json.at(0));
@@ -158,11 +161,122 @@ Geometry parse_geometry(List x){
   throw std::runtime_error("switch fall through");
 }
 
+// Delta encodes a WKB point, like coords_two() does for each point of a list
+static void wkb_point(wkb_reader &in, size_t wdim, Geometry &out, std::vector<double> &vec, bool add){
+  if(dim == 0)
+    dim = wdim;
+  if(dim != wdim)
+    throw std::runtime_error("Unequal coordinate dimensions");
+  vec.resize(dim);
+  for(size_t j = 0; j < dim; j++){
+    double val = in.real() * multiplier;
+    if(!std::isfinite(val))
+      throw std::runtime_error("Empty or non-finite coordinates in WKB geometry");
+    if(add){
+      out.add_coords(round(val - vec[j]));
+      vec[j] = val;
+    }
+  }
+}
+
+// Points of a WKB LineString or ring. Rings are stored without the closing point.
+static uint32_t wkb_points(wkb_reader &in, size_t wdim, Geometry &out, bool closed){
+  uint32_t points = in.count(wdim * 8);
+  uint32_t n = closed ? std::max(1u, points) - 1 : points;
+  std::vector<double> vec;
+  for(uint32_t i = 0; i < points; i++)
+    wkb_point(in, wdim, out, vec, i < n);
+  return n;
+}
+
+static void wkb_expect(wkb_reader &in, uint32_t type, size_t *wdim){
+  if(in.geometry(wdim) != type)
+    throw std::runtime_error("Unexpected geometry type inside WKB multi geometry");
+}
+
+Geometry parse_wkb(wkb_reader &in){
+  Geometry out;
+  size_t wdim;
+  uint32_t type = in.geometry(&wdim);
+  switch(type){
+  case WKB_POINT: {
+    std::vector<double> vec;
+    out.set_type(geobuf::Data_Geometry_Type_POINT);
+    wkb_point(in, wdim, out, vec, true);
+    break;
+  }
+  case WKB_LINESTRING:
+    out.set_type(geobuf::Data_Geometry_Type_LINESTRING);
+    wkb_points(in, wdim, out, false);
+    break;
+  case WKB_POLYGON: {
+    out.set_type(geobuf::Data_Geometry_Type_POLYGON);
+    uint32_t rings = in.count(4);
+    for(uint32_t i = 0; i < rings; i++)
+      out.add_lengths(wkb_points(in, wdim, out, true));
+    break;
+  }
+  case WKB_MULTIPOINT: {
+    out.set_type(geobuf::Data_Geometry_Type_MULTIPOINT);
+    uint32_t points = in.count(5);
+    std::vector<double> vec;
+    for(uint32_t i = 0; i < points; i++){
+      wkb_expect(in, WKB_POINT, &wdim);
+      wkb_point(in, wdim, out, vec, true);
+    }
+    break;
+  }
+  case WKB_MULTILINESTRING: {
+    out.set_type(geobuf::Data_Geometry_Type_MULTILINESTRING);
+    uint32_t lines = in.count(9);
+    for(uint32_t i = 0; i < lines; i++){
+      wkb_expect(in, WKB_LINESTRING, &wdim);
+      out.add_lengths(wkb_points(in, wdim, out, false));
+    }
+    break;
+  }
+  case WKB_MULTIPOLYGON: {
+    out.set_type(geobuf::Data_Geometry_Type_MULTIPOLYGON);
+    uint32_t polygons = in.count(9);
+    out.add_lengths(polygons);
+    for(uint32_t i = 0; i < polygons; i++){
+      wkb_expect(in, WKB_POLYGON, &wdim);
+      uint32_t rings = in.count(4);
+      out.add_lengths(rings);
+      for(uint32_t j = 0; j < rings; j++)
+        out.add_lengths(wkb_points(in, wdim, out, true));
+    }
+    break;
+  }
+  case WKB_GEOMETRYCOLLECTION: {
+    out.set_type(geobuf::Data_Geometry_Type_GEOMETRYCOLLECTION);
+    uint32_t geometries = in.count(9);
+    for(uint32_t i = 0; i < geometries; i++)
+      out.add_geometries()->CopyFrom(parse_wkb(in));
+    break;
+  }
+  }
+  return out;
+}
+
+Geometry parse_wkb(RawVector x){
+  wkb_reader in(x.begin(), x.size());
+  Geometry out = parse_wkb(in);
+  if(!in.done())
+    throw std::runtime_error("Trailing data after WKB geometry");
+  return out;
+}
+
 Feature parse_feature(List x){
   Feature out;
+  stats_items(1);
   if(!x.containsElementNamed("geometry"))
     throw std::runtime_error("feature does not contain geometry");
-  out.mutable_geometry()->CopyFrom(parse_geometry(x["geometry"]));
+  if(TYPEOF(x["geometry"]) == RAWSXP){
+    out.mutable_geometry()->CopyFrom(parse_wkb(RawVector(x["geometry"])));
+  } else {
+    out.mutable_geometry()->CopyFrom(parse_geometry(x["geometry"]));
+  }
   if(x.containsElementNamed("properties")){
     List properties = x["properties"];
     Rcpp::CharacterVector names = properties.names();
@@ -224,6 +338,8 @@ FeatureCollection parse_collection(List x){
 
 // [[Rcpp::export]]
 RawVector cpp_serialize_geobuf(List x, int decimals){
+  stats_call stats("cpp_serialize_geobuf", 0);
+  stats_phase materialize(PHASE_MATERIALIZE);
   keys.clear();
   Data message;
   message.set_precision(decimals);
@@ -246,12 +362,15 @@ RawVector cpp_serialize_geobuf(List x, int decimals){
   for(size_t i = 0; i < keys.size(); i++){
     message.add_keys(keys.at(i));
   }
+  stats_phase parse(PHASE_PARSE);
 #ifdef USENEWAPI
   long size = message.ByteSizeLong();
 #else
   int size = message.ByteSize();
 #endif
   RawVector res(size);
+  stats_bytes(size);
+  stats_est_alloc(1);
   if(!message.SerializeToArray(res.begin(), size))
     throw std::runtime_error("Failed to serialize into geobuf message");
   return res;
@@ -0,0 +1,360 @@
+#include "xxhash.h"
+#include <Rcpp.h>
+#include <algorithm>
+#include <cstdio>
+
+/* Fingerprint of an R object, computed from a canonical rexp.proto encoding
+ * without creating the message. This is the encoding of cpp_serialize_pb,
+ * except that attributes are sorted by name such that the hash does not depend
+ * on their order, so it usually differs from the output of serialize_pb().
+ * The encoding is written in two passes: the first computes the size of each
+ * (sub)message, which the wire format needs before the message itself, and
+ * the second streams the encoding into the hasher through a small buffer.
+ * The sizes take one size_t per object in the tree, and native objects are
+ * serialized in both passes, because their size is only known afterwards. */
+
+// Field tags of rexp.proto: (field number << 3) | wire type
+#define TAG_RCLASS 0x08
+#define TAG_REAL 0x12
+#define TAG_INT 0x1a
+#define TAG_BOOL 0x20
+#define TAG_STRING 0x2a
+#define TAG_RAW 0x32
+#define TAG_COMPLEX 0x3a
+#define TAG_REXP 0x42
+#define TAG_ATTRNAME 0x5a
+#define TAG_ATTRVALUE 0x62
+#define TAG_NATIVE 0x6a
+
+// Values of the RClass and RBOOLEAN enums
+enum { RCLASS_STRING = 0, RCLASS_RAW, RCLASS_REAL, RCLASS_COMPLEX, RCLASS_INTEGER,
+       RCLASS_LIST, RCLASS_LOGICAL, RCLASS_NULLTYPE, RCLASS_NATIVE };
+enum { BOOL_F = 0, BOOL_T, BOOL_NA };
+
+static size_t varint_size(uint64_t val){
+  size_t size = 1;
+  while(val >= 0x80){
+    val >>= 7;
+    size++;
+  }
+  return size;
+}
+
+// Size of a length delimited field with a payload of 'size' bytes
+static size_t field_size(size_t size){
+  return 1 + varint_size(size) + size;
+}
+
+static uint32_t zigzag_encode32(int32_t val){
+  return ((uint32_t) val << 1) ^ (uint32_t) (val >> 31);
+}
+
+static const char *utf8_string(SEXP x){
+  return Rf_translateCharUTF8(x);
+}
+
+// Attributes ordered by name
+static std::vector<std::pair<std::string, SEXP>> sorted_attributes(SEXP x){
+  std::vector<std::pair<std::string, SEXP>> attrs;
+  for(SEXP attr = ATTRIB(x); attr != R_NilValue; attr = CDR(attr))
+    attrs.push_back(std::make_pair(std::string(CHAR(PRINTNAME(TAG(attr)))), CAR(attr)));
+  std::sort(attrs.begin(), attrs.end(),
+            [](const std::pair<std::string, SEXP> &a, const std::pair<std::string, SEXP> &b){
+              return a.first < b.first;
+            });
+  return attrs;
+}
+
+static void count_byte(R_outpstream_t stream, int c){
+  (*(size_t*) stream->data)++;
+}
+
+static void count_bytes(R_outpstream_t stream, void *buf, int n){
+  *(size_t*) stream->data += n;
+}
+
+// Same format as serialize(x, NULL) in rexp_native()
+static size_t native_size(SEXP x){
+  size_t size = 0;
+  struct R_outpstream_st stream;
+  R_InitOutPStream(&stream, &size, R_pstream_xdr_format, 3, count_byte, count_bytes, NULL, R_NilValue);
+  R_Serialize(x, &stream);
+  return size;
+}
+
+class hash_writer {
+public:
+  hash_writer(bool skip_native) : skip_native(skip_native), next(0), used(0) {}
+
+  // First pass: size of the message of each object, in the order of the traversal
+  size_t measure(SEXP x){
+    size_t index = sizes.size();
+    sizes.push_back(0);
+    size_t size = 2;
+    R_xlen_t len = Rf_xlength(x);
+    switch(TYPEOF(x)){
+    case NILSXP:
+      break;
+    case LGLSXP:
+      size += len * 2;
+      break;
+    case INTSXP: {
+      size_t bytes = 0;
+      const int *val = INTEGER(x);
+      for(R_xlen_t i = 0; i < len; i++)
+        bytes += varint_size(zigzag_encode32(val[i]));
+      size += len ? field_size(bytes) : 0;
+      break;
+    }
+    case REALSXP:
+      size += len ? field_size(len * sizeof(double)) : 0;
+      break;
+    case CPLXSXP:
+      size += len * field_size(18);
+      break;
+    case RAWSXP:
+      size += field_size(len);
+      break;
+    case STRSXP:
+      for(R_xlen_t i = 0; i < len; i++){
+        SEXP el = STRING_ELT(x, i);
+        if(el == NA_STRING){
+          size += field_size(2);
+        } else {
+          const void *vmax = vmaxget();
+          size += field_size(field_size(strlen(utf8_string(el))) + 2);
+          vmaxset(vmax);
+        }
+      }
+      break;
+    case VECSXP:
+      for(R_xlen_t i = 0; i < len; i++)
+        size += field_size(measure(VECTOR_ELT(x, i)));
+      break;
+    default:
+      // The size of the serialized object is stored in the next slot
+      if(!skip_native){
+        size_t bytes = native_size(x);
+        sizes.push_back(bytes);
+        size += field_size(bytes);
+      }
+      sizes[index] = size;
+      return size;
+    }
+    std::vector<std::pair<std::string, SEXP>> attrs = sorted_attributes(x);
+    for(size_t i = 0; i < attrs.size(); i++)
+      size += field_size(attrs[i].first.size());
+    for(size_t i = 0; i < attrs.size(); i++)
+      size += field_size(measure(attrs[i].second));
+    sizes[index] = size;
+    return size;
+  }
+
+  // Second pass: write the encoding, in the same order as measure()
+  void write(SEXP x){
+    next++;
+    R_xlen_t len = Rf_xlength(x);
+    switch(TYPEOF(x)){
+    case NILSXP:
+      rclass(RCLASS_NULLTYPE);
+      break;
+    case LGLSXP: {
+      rclass(RCLASS_LOGICAL);
+      const int *val = LOGICAL(x);
+      for(R_xlen_t i = 0; i < len; i++){
+        byte(TAG_BOOL);
+        byte(val[i] == NA_LOGICAL ? BOOL_NA : (val[i] ? BOOL_T : BOOL_F));
+      }
+      break;
+    }
+    case INTSXP: {
+      rclass(RCLASS_INTEGER);
+      if(!len)
+        break;
+      const int *val = INTEGER(x);
+      size_t bytes = 0;
+      for(R_xlen_t i = 0; i < len; i++)
+        bytes += varint_size(zigzag_encode32(val[i]));
+      byte(TAG_INT);
+      varint(bytes);
+      for(R_xlen_t i = 0; i < len; i++)
+        varint(zigzag_encode32(val[i]));
+      break;
+    }
+    case REALSXP:
+      rclass(RCLASS_REAL);
+      if(!len)
+        break;
+      byte(TAG_REAL);
+      varint(len * sizeof(double));
+      doubles(REAL(x), len);
+      break;
+    case CPLXSXP: {
+      rclass(RCLASS_COMPLEX);
+      const Rcomplex *val = COMPLEX(x);
+      for(R_xlen_t i = 0; i < len; i++){
+        byte(TAG_COMPLEX);
+        byte(18);
+        byte(0x09);
+        doubles(&val[i].r, 1);
+        byte(0x11);
+        doubles(&val[i].i, 1);
+      }
+      break;
+    }
+    case RAWSXP:
+      rclass(RCLASS_RAW);
+      byte(TAG_RAW);
+      varint(len);
+      bytes(RAW(x), len);
+      break;
+    case STRSXP:
+      rclass(RCLASS_STRING);
+      for(R_xlen_t i = 0; i < len; i++){
+        SEXP el = STRING_ELT(x, i);
+        byte(TAG_STRING);
+        if(el == NA_STRING){
+          varint(2);
+          byte(0x10);
+          byte(1);
+        } else {
+          const void *vmax = vmaxget();
+          const char *str = utf8_string(el);
+          size_t size = strlen(str);
+          varint(field_size(size) + 2);
+          byte(0x0a);
+          varint(size);
+          bytes(str, size);
+          byte(0x10);
+          byte(0);
+          vmaxset(vmax);
+        }
+      }
+      break;
+    case VECSXP:
+      rclass(RCLASS_LIST);
+      for(R_xlen_t i = 0; i < len; i++){
+        byte(TAG_REXP);
+        varint(sizes.at(next));
+        write(VECTOR_ELT(x, i));
+      }
+      break;
+    default:
+      rclass(RCLASS_NATIVE);
+      if(!skip_native){
+        byte(TAG_NATIVE);
+        varint(sizes.at(next++));
+        native(x);
+      }
+      return;
+    }
+    std::vector<std::pair<std::string, SEXP>> attrs = sorted_attributes(x);
+    for(size_t i = 0; i < attrs.size(); i++){
+      byte(TAG_ATTRNAME);
+      varint(attrs[i].first.size());
+      bytes(attrs[i].first.data(), attrs[i].first.size());
+    }
+    for(size_t i = 0; i < attrs.size(); i++){
+      byte(TAG_ATTRVALUE);
+      varint(sizes.at(next));
+      write(attrs[i].second);
+    }
+  }
+
+  uint64_t digest(){
+    flush();
+    return state.digest();
+  }
+
+private:
+  bool skip_native;
+  std::vector<size_t> sizes;
+  size_t next;
+  xxh64 state;
+  uint8_t buf[4096];
+  size_t used;
+
+  void flush(){
+    state.update(buf, used);
+    used = 0;
+  }
+
+  void byte(uint8_t val){
+    if(used == sizeof(buf))
+      flush();
+    buf[used++] = val;
+  }
+
+  void varint(uint64_t val){
+    if(used + 10 > sizeof(buf))
+      flush();
+    while(val >= 0x80){
+      buf[used++] = (uint8_t) (val | 0x80);
+      val >>= 7;
+    }
+    buf[used++] = (uint8_t) val;
+  }
+
+  void rclass(int val){
+    byte(TAG_RCLASS);
+    byte(val);
+  }
+
+  void bytes(const void *data, size_t size){
+    if(used + size > sizeof(buf))
+      flush();
+    if(size > sizeof(buf)){
+      state.update(data, size);
+    } else {
+      memcpy(buf + used, data, size);
+      used += size;
+    }
+  }
+
+  // Doubles are little endian on the wire
+  void doubles(const double *val, size_t n){
+#ifdef WORDS_BIGENDIAN
+    for(size_t i = 0; i < n; i++){
+      uint8_t le[8];
+      memcpy(le, val + i, 8);
+      std::reverse(le, le + 8);
+      bytes(le, 8);
+    }
+#else
+    bytes(val, n * sizeof(double));
+#endif
+  }
+
+  static void native_byte(R_outpstream_t stream, int c){
+    ((hash_writer*) stream->data)->byte(c);
+  }
+
+  static void native_bytes(R_outpstream_t stream, void *buf, int n){
+    ((hash_writer*) stream->data)->bytes(buf, n);
+  }
+
+  void native(SEXP x){
+    struct R_outpstream_st stream;
+    R_InitOutPStream(&stream, this, R_pstream_xdr_format, 3, native_byte, native_bytes, NULL, R_NilValue);
+    R_Serialize(x, &stream);
+  }
+};
+
+static std::string hash_hex(uint64_t hash){
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016llx", (unsigned long long) hash);
+  return buf;
+}
+
+// [[Rcpp::export]]
+std::string cpp_hash_pb(Rcpp::RObject x, bool skip_native){
+  hash_writer writer(skip_native);
+  writer.measure(x);
+  writer.write(x);
+  return hash_hex(writer.digest());
+}
+
+// [[Rcpp::export]]
+std::string cpp_hash_raw(Rcpp::RawVector x){
+  return hash_hex(xxh64_hash(x.begin(), x.size()));
+}
@@ -0,0 +1,439 @@
+#include "geobuf.pb.h"
+#include "mvt.pb.h"
+#include "stats.h"
+#include "wire.h"
+#include <Rcpp.h>
+#include <cmath>
+#include <cstring>
+
+/* Summaries of geobuf and vector tile messages, to index many files quickly.
+ * These scan the wire format once and only keep counters: features and
+ * coordinates are not decoded into R objects or buffers. */
+
+#define MoveTo 1
+#define LineTo 2
+
+typedef geobuf::Data Data;
+typedef vector_tile::Tile Tile;
+
+// Bounding box of the first two dimensions
+struct bounds {
+  double xmin;
+  double ymin;
+  double xmax;
+  double ymax;
+
+  bounds() : xmin(INFINITY), ymin(INFINITY), xmax(-INFINITY), ymax(-INFINITY) {}
+
+  void add(double x, double y){
+    xmin = std::min(xmin, x);
+    ymin = std::min(ymin, y);
+    xmax = std::max(xmax, x);
+    ymax = std::max(ymax, y);
+  }
+
+  Rcpp::NumericVector get() const {
+    bool empty = xmin > xmax;
+    Rcpp::NumericVector out = Rcpp::NumericVector::create(
+      Rcpp::_["xmin"] = empty ? NA_REAL : xmin, Rcpp::_["ymin"] = empty ? NA_REAL : ymin,
+      Rcpp::_["xmax"] = empty ? NA_REAL : xmax, Rcpp::_["ymax"] = empty ? NA_REAL : ymax);
+    return out;
+  }
+};
+
+// The number of features with each key, and the types of their values as a
+// bitmask of the field numbers in the Value message.
+struct key_summary {
+  std::vector<std::string> names;
+  std::vector<double> features;
+  std::vector<uint32_t> types;
+
+  void add(uint64_t key, uint32_t fields){
+    if(key >= names.size())
+      throw std::runtime_error("Property key index out of bounds");
+    features[key]++;
+    types[key] |= fields;
+  }
+
+  void push_back(const std::string &name){
+    names.push_back(name);
+    features.push_back(0);
+    types.push_back(0);
+  }
+
+  // Columns for a data frame, with the type names of the fields joined by "|"
+  Rcpp::List get(const char **typenames, int ntypes) const {
+    std::vector<std::string> typestr;
+    for(size_t i = 0; i < names.size(); i++){
+      std::string val;
+      const char *last = "";
+      for(int field = 1; field < ntypes; field++){
+        if(!(types[i] & (1 << field)) || !strcmp(typenames[field], last))
+          continue;
+        if(val.size())
+          val += "|";
+        val += typenames[field];
+        last = typenames[field];
+      }
+      typestr.push_back(val);
+    }
+    return Rcpp::List::create(
+      Rcpp::_["key"] = names,
+      Rcpp::_["type"] = typestr,
+      Rcpp::_["features"] = features
+    );
+  }
+};
+
+// Field numbers in a Value message (of either format), as a bitmask
+static uint32_t value_fields(wire_span msg){
+  uint32_t fields = 0;
+  wire_reader in(msg);
+  while(in.next()){
+    if(in.field < 32)
+      fields |= 1 << in.field;
+    in.skip();
+  }
+  return fields;
+}
+
+static Rcpp::NumericVector histogram(const std::vector<double> &counts, const char **names){
+  Rcpp::NumericVector out(counts.begin(), counts.end());
+  Rcpp::CharacterVector labels(counts.size());
+  for(size_t i = 0; i < counts.size(); i++)
+    labels[i] = names[i];
+  out.attr("names") = labels;
+  return out;
+}
+
+/* Geobuf */
+
+static const char *geobuf_types[] = {"Point", "MultiPoint", "LineString", "MultiLineString",
+                                     "Polygon", "MultiPolygon", "GeometryCollection"};
+static const char *geobuf_values[] = {"", "string", "double", "integer", "integer", "bool", "json"};
+
+class geobuf_inspector {
+public:
+  uint32_t dim;
+  double multiplier;
+  double features;
+  double vertices;
+  std::vector<double> types;
+  bounds bbox;
+  key_summary keys;
+
+  geobuf_inspector() : dim(2), multiplier(1e6), features(0), vertices(0), types(7) {}
+
+  void feature(wire_span msg){
+    std::vector<wire_span> values;
+    std::vector<uint32_t> properties;
+    wire_reader in(msg);
+    while(in.next()){
+      switch(in.field){
+      case Data::Feature::kGeometryFieldNumber:
+        in.expect(WIRE_LENGTH);
+        geometry(in.bytes(), true);
+        break;
+      case Data::Feature::kValuesFieldNumber:
+        in.expect(WIRE_LENGTH);
+        values.push_back(in.bytes());
+        break;
+      case Data::Feature::kPropertiesFieldNumber:
+        in.varints([&](uint64_t val){ properties.push_back(val); });
+        break;
+      default:
+        in.skip();
+      }
+    }
+    for(size_t i = 0; i + 1 < properties.size(); i += 2){
+      if(properties[i + 1] >= values.size())
+        throw std::runtime_error("Property value index out of bounds");
+      keys.add(properties[i], value_fields(values[properties[i + 1]]));
+    }
+    features++;
+    stats_items(1);
+  }
+
+  void geometry(wire_span msg, bool top){
+    uint32_t type = 0;
+    std::vector<uint32_t> lengths;
+    wire_reader in(msg);
+    while(in.next()){
+      switch(in.field){
+      case Data::Geometry::kTypeFieldNumber:
+        in.expect(WIRE_VARINT);
+        type = in.varint();
+        break;
+      case Data::Geometry::kLengthsFieldNumber:
+        in.varints([&](uint64_t val){ lengths.push_back(val); });
+        break;
+      case Data::Geometry::kGeometriesFieldNumber:
+        in.expect(WIRE_LENGTH);
+        geometry(in.bytes(), false);
+        break;
+      default:
+        in.skip();
+      }
+    }
+    if(type >= types.size())
+      throw std::runtime_error("Unknown geobuf geometry type");
+    if(top)
+      types[type]++;
+    coordinates(msg, type, lengths);
+  }
+
+private:
+  // Sums the delta encoded coordinates of each line or ring (see ungeobuf.cpp)
+  // in a second pass over the message, when the lengths are known.
+  void coordinates(wire_span msg, uint32_t type, const std::vector<uint32_t> &lengths){
+    std::vector<uint32_t> runs;
+    if(lengths.size() && (type == Data::Geometry::POLYGON || type == Data::Geometry::MULTILINESTRING)){
+      runs = lengths;
+    } else if(lengths.size() && type == Data::Geometry::MULTIPOLYGON){
+      size_t cursor = 1;
+      for(uint32_t s = 0; s < lengths[0] && cursor < lengths.size(); s++){
+        uint32_t groups = lengths[cursor++];
+        for(uint32_t i = 0; i < groups && cursor < lengths.size(); i++)
+          runs.push_back(lengths[cursor++]);
+      }
+    }
+    size_t run = 0;
+    uint64_t left = runs.size() ? runs[0] : UINT64_MAX;
+    uint32_t component = 0;
+    int64_t sum[2] = {0, 0};
+    wire_reader in(msg);
+    while(in.next()){
+      if(in.field != Data::Geometry::kCoordsFieldNumber){
+        in.skip();
+        continue;
+      }
+      in.varints([&](uint64_t val){
+        while(component == 0 && left == 0){
+          // Next run, or the remaining coordinates if the lengths do not add up
+          left = ++run < runs.size() ? runs[run] : UINT64_MAX;
+          sum[0] = sum[1] = 0;
+        }
+        if(component < 2)
+          sum[component] += zigzag64(val);
+        if(++component == dim){
+          bbox.add(sum[0] / multiplier, sum[1] / multiplier);
+          vertices++;
+          component = 0;
+          left--;
+        }
+      });
+    }
+  }
+};
+
+// [[Rcpp::export]]
+Rcpp::List cpp_inspect_geobuf(Rcpp::RawVector x){
+  stats_call stats("cpp_inspect_geobuf", x.size());
+  stats_phase phase(PHASE_PARSE);
+  geobuf_inspector out;
+  uint32_t precision = 6;
+  int data_field = 0;
+  wire_span data = {NULL, 0};
+  wire_reader in(x.begin(), x.size());
+  while(in.next()){
+    switch(in.field){
+    case Data::kKeysFieldNumber:
+      in.expect(WIRE_LENGTH);
+      out.keys.push_back(in.string());
+      break;
+    case Data::kDimensionsFieldNumber:
+      in.expect(WIRE_VARINT);
+      out.dim = in.varint();
+      break;
+    case Data::kPrecisionFieldNumber:
+      in.expect(WIRE_VARINT);
+      precision = in.varint();
+      break;
+    case Data::kFeatureCollectionFieldNumber:
+    case Data::kFeatureFieldNumber:
+    case Data::kGeometryFieldNumber:
+      in.expect(WIRE_LENGTH);
+      data_field = in.field;
+      data = in.bytes();
+      break;
+    default:
+      in.skip();
+    }
+  }
+  if(out.dim < 1)
+    throw std::runtime_error("Geobuf dimensions must be at least 1");
+  out.multiplier = pow(10.0, precision);
+  std::string type;
+  if(data_field == Data::kFeatureCollectionFieldNumber){
+    type = "FeatureCollection";
+    wire_reader collection(data);
+    while(collection.next()){
+      if(collection.field == Data::FeatureCollection::kFeaturesFieldNumber){
+        collection.expect(WIRE_LENGTH);
+        out.feature(collection.bytes());
+      } else {
+        collection.skip();
+      }
+    }
+  } else if(data_field == Data::kFeatureFieldNumber){
+    type = "Feature";
+    out.feature(data);
+  } else if(data_field == Data::kGeometryFieldNumber){
+    type = "Geometry";
+    out.geometry(data, true);
+  } else {
+    throw std::runtime_error("No 'data_type' field set");
+  }
+  return Rcpp::List::create(
+    Rcpp::_["type"] = type,
+    Rcpp::_["dimensions"] = out.dim,
+    Rcpp::_["precision"] = precision,
+    Rcpp::_["features"] = out.features,
+    Rcpp::_["types"] = histogram(out.types, geobuf_types),
+    Rcpp::_["vertices"] = out.vertices,
+    Rcpp::_["bbox"] = out.bbox.get(),
+    Rcpp::_["keys"] = out.keys.get(geobuf_values, 7)
+  );
+}
+
+/* Vector tiles */
+
+static const char *mvt_types[] = {"UNKNOWN", "POINT", "LINESTRING", "POLYGON"};
+static const char *mvt_values[] = {"", "string", "float", "double", "int", "uint", "sint", "bool"};
+
+// Walks the commands of the geometry to count the vertices and update the
+// bounding box (in tile coordinates). ClosePath has no parameters.
+static double inspect_geometry(wire_reader &in, bounds &bbox){
+  double vertices = 0;
+  uint64_t params = 0;
+  bool has_dx = false;
+  int32_t dx = 0;
+  int64_t cx = 0;
+  int64_t cy = 0;
+  in.varints([&](uint64_t val){
+    if(!params){
+      uint32_t cmd = val & 0x7;
+      if(cmd == MoveTo || cmd == LineTo)
+        params = 2 * (val >> 3);
+      return;
+    }
+    params--;
+    if(!has_dx){
+      dx = zigzag32(val);
+      has_dx = true;
+      return;
+    }
+    has_dx = false;
+    cx += dx;
+    cy += zigzag32(val);
+    bbox.add(cx, cy);
+    vertices++;
+  });
+  if(params)
+    throw std::runtime_error("Truncated geometry in vector tile feature");
+  return vertices;
+}
+
+static Rcpp::List inspect_layer(wire_span msg){
+  std::string name;
+  uint32_t version = 1;
+  uint32_t extent = 4096;
+  std::vector<wire_span> features;
+  std::vector<uint32_t> values;
+  key_summary keys;
+  wire_reader in(msg);
+  while(in.next()){
+    switch(in.field){
+    case Tile::Layer::kNameFieldNumber:
+      in.expect(WIRE_LENGTH);
+      name = in.string();
+      break;
+    case Tile::Layer::kFeaturesFieldNumber:
+      in.expect(WIRE_LENGTH);
+      features.push_back(in.bytes());
+      break;
+    case Tile::Layer::kKeysFieldNumber:
+      in.expect(WIRE_LENGTH);
+      keys.push_back(in.string());
+      break;
+    case Tile::Layer::kValuesFieldNumber:
+      in.expect(WIRE_LENGTH);
+      values.push_back(value_fields(in.bytes()));
+      break;
+    case Tile::Layer::kExtentFieldNumber:
+      in.expect(WIRE_VARINT);
+      extent = in.varint();
+      break;
+    case Tile::Layer::kVersionFieldNumber:
+      in.expect(WIRE_VARINT);
+      version = in.varint();
+      break;
+    default:
+      in.skip();
+    }
+  }
+  std::vector<double> types(4);
+  double vertices = 0;
+  bounds bbox;
+  for(size_t i = 0; i < features.size(); i++){
+    uint32_t type = Tile::UNKNOWN;
+    uint64_t key = 0;
+    bool has_key = false;
+    wire_reader feature(features[i]);
+    while(feature.next()){
+      switch(feature.field){
+      case Tile::Feature::kTypeFieldNumber:
+        feature.expect(WIRE_VARINT);
+        type = feature.varint();
+        break;
+      case Tile::Feature::kTagsFieldNumber:
+        feature.varints([&](uint64_t val){
+          if(!has_key){
+            key = val;
+            has_key = true;
+            return;
+          }
+          has_key = false;
+          if(val >= values.size())
+            throw std::runtime_error("Tag value index out of bounds");
+          keys.add(key, values[val]);
+        });
+        break;
+      case Tile::Feature::kGeometryFieldNumber:
+        vertices += inspect_geometry(feature, bbox);
+        break;
+      default:
+        feature.skip();
+      }
+    }
+    types[type < types.size() ? type : 0]++;
+    stats_items(1);
+  }
+  return Rcpp::List::create(
+    Rcpp::_["name"] = name,
+    Rcpp::_["version"] = version,
+    Rcpp::_["extent"] = extent,
+    Rcpp::_["features"] = (double) features.size(),
+    Rcpp::_["types"] = histogram(types, mvt_types),
+    Rcpp::_["vertices"] = vertices,
+    Rcpp::_["bbox"] = bbox.get(),
+    Rcpp::_["keys"] = keys.get(mvt_values, 8)
+  );
+}
+
+// [[Rcpp::export]]
+Rcpp::List cpp_inspect_mvt(Rcpp::RawVector x){
+  stats_call stats("cpp_inspect_mvt", x.size());
+  stats_phase phase(PHASE_PARSE);
+  Rcpp::List out;
+  wire_reader in(x.begin(), x.size());
+  while(in.next()){
+    if(in.field == Tile::kLayersFieldNumber){
+      in.expect(WIRE_LENGTH);
+      out.push_back(inspect_layer(in.bytes()));
+    } else {
+      in.skip();
+    }
+  }
+  return out;
+}
@@ -0,0 +1,411 @@
+#include "kernel.h"
+#include "wire.h"
+#include <stdexcept>
+#include <string>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNEL_SSE2 1
+#include <immintrin.h>
+#define KERNEL_TARGET(x) __attribute__((target(x)))
+// MinGW does not align the stack for 256-bit spills, so no AVX2 on Windows
+#ifndef _WIN32
+#define KERNEL_AVX2 1
+#endif
+#endif
+
+struct kernel_impl {
+  const char *name;
+  size_t (*count_varints)(const uint8_t *buf, size_t len);
+  size_t (*varints32)(const uint8_t *buf, size_t len, uint32_t *out);
+  size_t (*varints64)(const uint8_t *buf, size_t len, uint64_t *out);
+  void (*zigzag64)(const uint64_t *in, size_t n, int64_t *out);
+  void (*delta)(const int64_t *in, size_t npoints, size_t dim, double scale, double *out);
+  void (*delta_zigzag32)(const uint32_t *in, size_t npoints, int64_t state[2], double scale, double *x, double *y);
+};
+
+/* Scalar versions. Sums use unsigned arithmetic so that overflow wraps the same
+ * way in every version. */
+
+static inline uint64_t varint_at(const uint8_t *&pos, const uint8_t *end){
+  wire_reader in(pos, end - pos);
+  uint64_t val = in.varint();
+  pos = in.pos;
+  return val;
+}
+
+static size_t count_varints_scalar(const uint8_t *buf, size_t len){
+  size_t n = 0;
+  for(size_t i = 0; i < len; i++)
+    n += buf[i] < 0x80;
+  return n;
+}
+
+template <typename T>
+static size_t varints_scalar(const uint8_t *buf, size_t len, T *out){
+  const uint8_t *pos = buf;
+  const uint8_t *end = buf + len;
+  size_t n = 0;
+  while(pos < end)
+    out[n++] = (T) varint_at(pos, end);
+  return n;
+}
+
+static void zigzag64_scalar(const uint64_t *in, size_t n, int64_t *out){
+  for(size_t i = 0; i < n; i++)
+    out[i] = zigzag64(in[i]);
+}
+
+static void delta_scalar(const int64_t *in, size_t npoints, size_t dim, double scale, double *out){
+  for(size_t j = 0; j < dim; j++){
+    uint64_t sum = 0;
+    for(size_t i = 0; i < npoints; i++){
+      sum += (uint64_t) in[i * dim + j];
+      out[i * dim + j] = (int64_t) sum / scale;
+    }
+  }
+}
+
+static void delta_zigzag32_scalar(const uint32_t *in, size_t npoints, int64_t state[2],
+                                  double scale, double *x, double *y){
+  uint64_t sx = state[0];
+  uint64_t sy = state[1];
+  for(size_t i = 0; i < npoints; i++){
+    sx += (uint64_t) (int64_t) zigzag32(in[2 * i]);
+    sy += (uint64_t) (int64_t) zigzag32(in[2 * i + 1]);
+    x[i] = (int64_t) sx / scale;
+    y[i] = (int64_t) sy / scale;
+  }
+  state[0] = sx;
+  state[1] = sy;
+}
+
+static const kernel_impl kernel_scalar = {
+  "scalar", count_varints_scalar, varints_scalar<uint32_t>, varints_scalar<uint64_t>,
+  zigzag64_scalar, delta_scalar, delta_zigzag32_scalar
+};
+
+/* SSE2 versions. The varint decoders take a fast path for blocks of 16 bytes
+ * without continuation bits, which are 16 single byte values. This is the common
+ * case for the small deltas in geometries. */
+
+#ifdef KERNEL_SSE2
+
+KERNEL_TARGET("sse2")
+static size_t count_varints_sse2(const uint8_t *buf, size_t len){
+  size_t n = 0;
+  size_t i = 0;
+  for(; i + 16 <= len; i += 16){
+    int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) (buf + i)));
+    n += 16 - __builtin_popcount(mask);
+  }
+  return n + count_varints_scalar(buf + i, len - i);
+}
+
+KERNEL_TARGET("sse2")
+static size_t varints32_sse2(const uint8_t *buf, size_t len, uint32_t *out){
+  const uint8_t *pos = buf;
+  const uint8_t *end = buf + len;
+  const __m128i zero = _mm_setzero_si128();
+  size_t n = 0;
+  while(end - pos >= 16){
+    __m128i bytes = _mm_loadu_si128((const __m128i*) pos);
+    int mask = _mm_movemask_epi8(bytes);
+    if(mask == 0){
+      __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+      __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+      _mm_storeu_si128((__m128i*) (out + n), _mm_unpacklo_epi16(lo, zero));
+      _mm_storeu_si128((__m128i*) (out + n + 4), _mm_unpackhi_epi16(lo, zero));
+      _mm_storeu_si128((__m128i*) (out + n + 8), _mm_unpacklo_epi16(hi, zero));
+      _mm_storeu_si128((__m128i*) (out + n + 12), _mm_unpackhi_epi16(hi, zero));
+      n += 16;
+      pos += 16;
+    } else {
+      // Single byte values up to the first multi-byte varint
+      int run = __builtin_ctz(mask);
+      for(int k = 0; k < run; k++)
+        out[n++] = pos[k];
+      pos += run;
+      out[n++] = (uint32_t) varint_at(pos, end);
+    }
+  }
+  while(pos < end)
+    out[n++] = (uint32_t) varint_at(pos, end);
+  return n;
+}
+
+KERNEL_TARGET("sse2")
+static size_t varints64_sse2(const uint8_t *buf, size_t len, uint64_t *out){
+  const uint8_t *pos = buf;
+  const uint8_t *end = buf + len;
+  const __m128i zero = _mm_setzero_si128();
+  size_t n = 0;
+  while(end - pos >= 16){
+    __m128i bytes = _mm_loadu_si128((const __m128i*) pos);
+    int mask = _mm_movemask_epi8(bytes);
+    if(mask == 0){
+      __m128i half[2] = {_mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero)};
+      for(int h = 0; h < 2; h++){
+        __m128i lo = _mm_unpacklo_epi16(half[h], zero);
+        __m128i hi = _mm_unpackhi_epi16(half[h], zero);
+        _mm_storeu_si128((__m128i*) (out + n), _mm_unpacklo_epi32(lo, zero));
+        _mm_storeu_si128((__m128i*) (out + n + 2), _mm_unpackhi_epi32(lo, zero));
+        _mm_storeu_si128((__m128i*) (out + n + 4), _mm_unpacklo_epi32(hi, zero));
+        _mm_storeu_si128((__m128i*) (out + n + 6), _mm_unpackhi_epi32(hi, zero));
+        n += 8;
+      }
+      pos += 16;
+    } else {
+      int run = __builtin_ctz(mask);
+      for(int k = 0; k < run; k++)
+        out[n++] = pos[k];
+      pos += run;
+      out[n++] = varint_at(pos, end);
+    }
+  }
+  while(pos < end)
+    out[n++] = varint_at(pos, end);
+  return n;
+}
+
+KERNEL_TARGET("sse2")
+static void zigzag64_sse2(const uint64_t *in, size_t n, int64_t *out){
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi64x(1);
+  size_t i = 0;
+  for(; i + 2 <= n; i += 2){
+    __m128i val = _mm_loadu_si128((const __m128i*) (in + i));
+    __m128i sign = _mm_sub_epi64(zero, _mm_and_si128(val, one));
+    _mm_storeu_si128((__m128i*) (out + i), _mm_xor_si128(_mm_srli_epi64(val, 1), sign));
+  }
+  zigzag64_scalar(in + i, n - i, out + i);
+}
+
+static const kernel_impl kernel_sse2 = {
+  "sse2", count_varints_sse2, varints32_sse2, varints64_sse2,
+  zigzag64_sse2, delta_scalar, delta_zigzag32_scalar
+};
+
+#endif
+
+/* AVX2 versions. These process 32 bytes per step in the varint decoders, and
+ * two points per step in the prefix sums for 2D coordinates. */
+
+#ifdef KERNEL_AVX2
+
+KERNEL_TARGET("avx2")
+static size_t count_varints_avx2(const uint8_t *buf, size_t len){
+  size_t n = 0;
+  size_t i = 0;
+  for(; i + 32 <= len; i += 32){
+    uint32_t mask = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*) (buf + i)));
+    n += 32 - __builtin_popcount(mask);
+  }
+  return n + count_varints_scalar(buf + i, len - i);
+}
+
+KERNEL_TARGET("avx2")
+static size_t varints32_avx2(const uint8_t *buf, size_t len, uint32_t *out){
+  const uint8_t *pos = buf;
+  const uint8_t *end = buf + len;
+  size_t n = 0;
+  while(end - pos >= 32){
+    uint32_t mask = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*) pos));
+    if(mask == 0){
+      for(int k = 0; k < 4; k++){
+        __m128i bytes = _mm_loadl_epi64((const __m128i*) (pos + 8 * k));
+        _mm256_storeu_si256((__m256i*) (out + n + 8 * k), _mm256_cvtepu8_epi32(bytes));
+      }
+      n += 32;
+      pos += 32;
+    } else {
+      int run = __builtin_ctz(mask);
+      for(int k = 0; k < run; k++)
+        out[n++] = pos[k];
+      pos += run;
+      out[n++] = (uint32_t) varint_at(pos, end);
+    }
+  }
+  while(pos < end)
+    out[n++] = (uint32_t) varint_at(pos, end);
+  return n;
+}
+
+KERNEL_TARGET("avx2")
+static size_t varints64_avx2(const uint8_t *buf, size_t len, uint64_t *out){
+  const uint8_t *pos = buf;
+  const uint8_t *end = buf + len;
+  size_t n = 0;
+  while(end - pos >= 32){
+    uint32_t mask = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*) pos));
+    if(mask == 0){
+      for(int k = 0; k < 8; k++){
+        int32_t word;
+        memcpy(&word, pos + 4 * k, 4);
+        _mm256_storeu_si256((__m256i*) (out + n + 4 * k), _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(word)));
+      }
+      n += 32;
+      pos += 32;
+    } else {
+      int run = __builtin_ctz(mask);
+      for(int k = 0; k < run; k++)
+        out[n++] = pos[k];
+      pos += run;
+      out[n++] = varint_at(pos, end);
+    }
+  }
+  while(pos < end)
+    out[n++] = varint_at(pos, end);
+  return n;
+}
+
+KERNEL_TARGET("avx2")
+static void zigzag64_avx2(const uint64_t *in, size_t n, int64_t *out){
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi64x(1);
+  size_t i = 0;
+  for(; i + 4 <= n; i += 4){
+    __m256i val = _mm256_loadu_si256((const __m256i*) (in + i));
+    __m256i sign = _mm256_sub_epi64(zero, _mm256_and_si256(val, one));
+    _mm256_storeu_si256((__m256i*) (out + i), _mm256_xor_si256(_mm256_srli_epi64(val, 1), sign));
+  }
+  zigzag64_scalar(in + i, n - i, out + i);
+}
+
+// Exact int64 to double conversion (there is no instruction for this in AVX2):
+// the high and low 32 bits are converted separately with the 2^52 trick.
+KERNEL_TARGET("avx2")
+static inline __m256d int64_to_double_avx2(__m256i x){
+  __m256i hi = _mm256_srai_epi32(x, 16);
+  hi = _mm256_blend_epi16(hi, _mm256_setzero_si256(), 0x33);
+  hi = _mm256_add_epi64(hi, _mm256_castpd_si256(_mm256_set1_pd(442721857769029238784.))); // 3 * 2^67
+  __m256i lo = _mm256_blend_epi16(x, _mm256_castpd_si256(_mm256_set1_pd(0x0010000000000000)), 0x88); // 2^52
+  __m256d high = _mm256_sub_pd(_mm256_castsi256_pd(hi), _mm256_set1_pd(442726361368656609280.)); // 3 * 2^67 + 2^52
+  return _mm256_add_pd(high, _mm256_castsi256_pd(lo));
+}
+
+// Prefix sum of two 2D points [x0 y0 x1 y1] plus the running [x y x y]
+KERNEL_TARGET("avx2")
+static inline __m256i prefix2_avx2(__m256i val, __m256i &state){
+  val = _mm256_add_epi64(val, _mm256_permute2x128_si256(val, val, 0x08));
+  val = _mm256_add_epi64(val, state);
+  state = _mm256_permute4x64_epi64(val, 0xEE);
+  return val;
+}
+
+KERNEL_TARGET("avx2")
+static void delta_avx2(const int64_t *in, size_t npoints, size_t dim, double scale, double *out){
+  if(dim != 2)
+    return delta_scalar(in, npoints, dim, scale, out);
+  const __m256d div = _mm256_set1_pd(scale);
+  __m256i state = _mm256_setzero_si256();
+  size_t i = 0;
+  for(; i + 2 <= npoints; i += 2){
+    __m256i val = prefix2_avx2(_mm256_loadu_si256((const __m256i*) (in + 2 * i)), state);
+    _mm256_storeu_pd(out + 2 * i, _mm256_div_pd(int64_to_double_avx2(val), div));
+  }
+  if(i < npoints){
+    int64_t sum[4];
+    _mm256_storeu_si256((__m256i*) sum, state);
+    out[2 * i] = (int64_t) ((uint64_t) sum[0] + (uint64_t) in[2 * i]) / scale;
+    out[2 * i + 1] = (int64_t) ((uint64_t) sum[1] + (uint64_t) in[2 * i + 1]) / scale;
+  }
+}
+
+KERNEL_TARGET("avx2")
+static void delta_zigzag32_avx2(const uint32_t *in, size_t npoints, int64_t state[2],
+                                double scale, double *x, double *y){
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256d div = _mm256_set1_pd(scale);
+  __m256i sum = _mm256_set_epi64x(state[1], state[0], state[1], state[0]);
+  size_t i = 0;
+  for(; i + 4 <= npoints; i += 4){
+    __m256i val = _mm256_loadu_si256((const __m256i*) (in + 2 * i));
+    val = _mm256_xor_si256(_mm256_srli_epi32(val, 1), _mm256_sub_epi32(zero, _mm256_and_si256(val, one)));
+    __m256i a = prefix2_avx2(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(val)), sum);
+    __m256i b = prefix2_avx2(_mm256_cvtepi32_epi64(_mm256_extracti128_si256(val, 1)), sum);
+    __m256d da = _mm256_div_pd(int64_to_double_avx2(a), div);
+    __m256d db = _mm256_div_pd(int64_to_double_avx2(b), div);
+    _mm256_storeu_pd(x + i, _mm256_permute4x64_pd(_mm256_unpacklo_pd(da, db), 0xD8));
+    _mm256_storeu_pd(y + i, _mm256_permute4x64_pd(_mm256_unpackhi_pd(da, db), 0xD8));
+  }
+  int64_t tmp[4];
+  _mm256_storeu_si256((__m256i*) tmp, sum);
+  state[0] = tmp[0];
+  state[1] = tmp[1];
+  delta_zigzag32_scalar(in + 2 * i, npoints - i, state, scale, x + i, y + i);
+}
+
+static const kernel_impl kernel_avx2 = {
+  "avx2", count_varints_avx2, varints32_avx2, varints64_avx2,
+  zigzag64_avx2, delta_avx2, delta_zigzag32_avx2
+};
+
+#endif
+
+static const kernel_impl *kernel_detect(){
+#ifdef KERNEL_SSE2
+  __builtin_cpu_init();
+#ifdef KERNEL_AVX2
+  if(__builtin_cpu_supports("avx2"))
+    return &kernel_avx2;
+#endif
+  if(__builtin_cpu_supports("sse2"))
+    return &kernel_sse2;
+#endif
+  return &kernel_scalar;
+}
+
+static const kernel_impl *kernel = kernel_detect();
+
+size_t kernel_count_varints(const uint8_t *buf, size_t len){
+  return kernel->count_varints(buf, len);
+}
+
+size_t kernel_varints32(const uint8_t *buf, size_t len, uint32_t *out){
+  return kernel->varints32(buf, len, out);
+}
+
+size_t kernel_varints64(const uint8_t *buf, size_t len, uint64_t *out){
+  return kernel->varints64(buf, len, out);
+}
+
+void kernel_zigzag64(const uint64_t *in, size_t n, int64_t *out){
+  kernel->zigzag64(in, n, out);
+}
+
+void kernel_delta(const int64_t *in, size_t npoints, size_t dim, double scale, double *out){
+  kernel->delta(in, npoints, dim, scale, out);
+}
+
+void kernel_delta_zigzag32(const uint32_t *in, size_t npoints, int64_t state[2],
+                           double scale, double *x, double *y){
+  kernel->delta_zigzag32(in, npoints, state, scale, x, y);
+}
+
+const char *kernel_name(){
+  return kernel->name;
+}
+
+// Select the implementation, mainly for testing. Returns the previous one.
+// [[Rcpp::export]]
+std::string cpp_kernel_select(std::string name){
+  std::string prev = kernel->name;
+  const kernel_impl *best = kernel_detect();
+  if(name == "auto"){
+    kernel = best;
+  } else if(name == "scalar"){
+    kernel = &kernel_scalar;
+#ifdef KERNEL_SSE2
+  } else if(name == "sse2" && best != &kernel_scalar){
+    kernel = &kernel_sse2;
+#endif
+#ifdef KERNEL_AVX2
+  } else if(name == "avx2" && best == &kernel_avx2){
+    kernel = &kernel_avx2;
+#endif
+  } else {
+    throw std::runtime_error("Kernel not supported on this CPU: " + name);
+  }
+  return prev;
+}
@@ -0,0 +1,65 @@
+#ifndef PROTOLITE_KERNEL_H
+#define PROTOLITE_KERNEL_H
+
+// Bulk decoding of packed varints and delta-encoded coordinates, shared by the
+// geobuf and mvt decoders. Each function has a scalar implementation and, on x86,
+// SSE2 and AVX2 versions that are selected at runtime based on the CPU. All
+// versions give identical results.
+
+#include "wire.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Number of varints in a packed field (the number of terminating bytes)
+size_t kernel_count_varints(const uint8_t *buf, size_t len);
+
+// Decode a packed field into 'out', which must have room for the number of values
+// from kernel_count_varints(). Values are truncated to 32 bits like in protobuf.
+size_t kernel_varints32(const uint8_t *buf, size_t len, uint32_t *out);
+size_t kernel_varints64(const uint8_t *buf, size_t len, uint64_t *out);
+
+// Zigzag decode of sint64 values, in place is allowed
+void kernel_zigzag64(const uint64_t *in, size_t n, int64_t *out);
+
+// Prefix-sum of 'npoints' delta encoded points with 'dim' dimensions, each divided
+// by 'scale' (geobuf coordinates). Input and output are interleaved per point.
+void kernel_delta(const int64_t *in, size_t npoints, size_t dim, double scale, double *out);
+
+// Zigzag decode and prefix-sum of interleaved x/y parameters (mvt geometry). The
+// running position is kept in 'state'. Output is written to separate x and y arrays.
+void kernel_delta_zigzag32(const uint32_t *in, size_t npoints, int64_t state[2],
+                           double scale, double *x, double *y);
+
+// Name of the active implementation: "scalar", "sse2" or "avx2"
+const char *kernel_name();
+
+// Append the values of a repeated field at the current position of the reader
+static inline void kernel_packed_uint32(wire_reader &in, std::vector<uint32_t> &out){
+  if(in.type != WIRE_LENGTH){
+    in.expect(WIRE_VARINT);
+    out.push_back(in.varint());
+    return;
+  }
+  wire_span span = in.bytes();
+  size_t n = out.size();
+  out.resize(n + kernel_count_varints(span.data, span.size));
+  kernel_varints32(span.data, span.size, out.data() + n);
+}
+
+static inline void kernel_packed_sint64(wire_reader &in, std::vector<int64_t> &out){
+  if(in.type != WIRE_LENGTH){
+    in.expect(WIRE_VARINT);
+    out.push_back(zigzag64(in.varint()));
+    return;
+  }
+  wire_span span = in.bytes();
+  size_t n = out.size();
+  size_t count = kernel_count_varints(span.data, span.size);
+  out.resize(n + count);
+  uint64_t *vals = reinterpret_cast<uint64_t*>(out.data() + n);
+  kernel_varints64(span.data, span.size, vals);
+  kernel_zigzag64(vals, count, out.data() + n);
+}
+
+#endif
@@ -1,28 +1,33 @@
 #include "rexp.pb.h"
+#include "stats.h"
 #include <Rcpp.h>
+#include <climits>
+#include <unordered_map>
 
 //using namespace Rcpp;
 
-rexp::REXP rexp_real(Rcpp::NumericVector x){
+// Atomic vectors are encoded from element 'from' up to 'to', such that long
+// vectors can be split over multiple messages (see chunked.cpp).
+rexp::REXP rexp_real(Rcpp::NumericVector x, R_xlen_t from, R_xlen_t to){
   rexp::REXP out;
   out.set_rclass(rexp::REXP_RClass_REAL);
-  for(int i = 0; i < x.length(); i++)
+  for(R_xlen_t i = from; i < to; i++)
     out.add_realvalue(x[i]);
   return out;
 }
 
-rexp::REXP rexp_int(Rcpp::IntegerVector x){
+rexp::REXP rexp_int(Rcpp::IntegerVector x, R_xlen_t from, R_xlen_t to){
   rexp::REXP out;
   out.set_rclass(rexp::REXP_RClass_INTEGER);
-  for(int i = 0; i < x.length(); i++)
+  for(R_xlen_t i = from; i < to; i++)
     out.add_intvalue(x[i]);
   return out;
 }
 
-rexp::REXP rexp_bool(Rcpp::LogicalVector x){
+rexp::REXP rexp_bool(Rcpp::LogicalVector x, R_xlen_t from, R_xlen_t to){
   rexp::REXP out;
   out.set_rclass(rexp::REXP_RClass_LOGICAL);
-  for(int i = 0; i < x.length(); i++){
+  for(R_xlen_t i = from; i < to; i++){
     rexp::REXP_RBOOLEAN val = Rcpp::LogicalVector::is_na(x[i]) ? rexp::REXP_RBOOLEAN_NA :
       (x[i] ? rexp::REXP_RBOOLEAN_T : rexp::REXP_RBOOLEAN_F);
     out.add_booleanvalue(val);
@@ -30,10 +35,10 @@ rexp::REXP rexp_bool(Rcpp::LogicalVector x){
   return out;
 }
 
-rexp::REXP rexp_string(Rcpp::StringVector x){
+rexp::REXP rexp_string(Rcpp::StringVector x, R_xlen_t from, R_xlen_t to){
   rexp::REXP out;
   out.set_rclass(rexp::REXP_RClass_STRING);
-  for(int i = 0; i < x.length(); i++){
+  for(R_xlen_t i = from; i < to; i++){
     rexp::STRING *val = out.add_stringvalue();
     if(Rcpp::StringVector::is_na(x[i])){
       val->set_isna(true);
@@ -48,10 +53,56 @@ rexp::REXP rexp_string(Rcpp::StringVector x){
   return out;
 }
 
-rexp::REXP rexp_raw(Rcpp::RawVector x){
+// Compact profile: dictionary of unique strings plus an index per element.
+// CHARSXP are cached by R so we can use the pointer as the dictionary key.
+rexp::REXP rexp_string_dict(Rcpp::StringVector x, R_xlen_t from, R_xlen_t to){
+  rexp::REXP out;
+  out.set_rclass(rexp::REXP_RClass_STRINGDICT);
+  std::unordered_map<SEXP, uint32_t> dict;
+  out.mutable_stringindex()->Reserve(to - from);
+  for(R_xlen_t i = from; i < to; i++){
+    SEXP val = STRING_ELT(x, i);
+    if(val == NA_STRING){
+      out.add_stringindex(0);
+      continue;
+    }
+    std::unordered_map<SEXP, uint32_t>::iterator it = dict.find(val);
+    if(it == dict.end()){
+      it = dict.insert(std::make_pair(val, (uint32_t) dict.size() + 1)).first;
+      out.add_stringdict(Rf_translateCharUTF8(val));
+    }
+    out.add_stringindex(it->second);
+  }
+  return out;
+}
+
+// Compact profile: bit-packed values with a separate NA mask
+rexp::REXP rexp_bool_bits(Rcpp::LogicalVector x, R_xlen_t from, R_xlen_t to){
+  rexp::REXP out;
+  out.set_rclass(rexp::REXP_RClass_LOGICALBITS);
+  R_xlen_t len = to - from;
+  std::string bits((len + 7) / 8, 0);
+  std::string na((len + 7) / 8, 0);
+  bool has_na = false;
+  for(R_xlen_t i = 0; i < len; i++){
+    if(x[from + i] == NA_LOGICAL){
+      na[i / 8] |= 1 << (i % 8);
+      has_na = true;
+    } else if(x[from + i]){
+      bits[i / 8] |= 1 << (i % 8);
+    }
+  }
+  out.set_length(len);
+  out.set_booleanbits(bits);
+  if(has_na)
+    out.set_booleanna(na);
+  return out;
+}
+
+rexp::REXP rexp_raw(Rcpp::RawVector x, R_xlen_t from, R_xlen_t to){
   rexp::REXP out;
   out.set_rclass(rexp::REXP_RClass_RAW);
-  out.set_rawvalue(x.begin(), x.length());
+  out.set_rawvalue(x.begin() + from, to - from);
   return out;
 }
 
@@ -66,6 +117,7 @@ rexp::REXP rexp_native(Rcpp::RObject x, bool skip_native){
     Rcpp::Function serialize = Rcpp::Environment::namespace_env("base")["serialize"];
     Rcpp::RawVector buf = serialize(x, R_NilValue);
   */
+  stats_phase phase(PHASE_CALLBACK);
   Rcpp::Environment env;
   env["MY_R_OBJECT"] = x;
   Rcpp::ExpressionVector expr("serialize(MY_R_OBJECT, NULL)");
@@ -74,10 +126,10 @@ rexp::REXP rexp_native(Rcpp::RObject x, bool skip_native){
   return out;
 }
 
-rexp::REXP rexp_complex(Rcpp::ComplexVector x){
+rexp::REXP rexp_complex(Rcpp::ComplexVector x, R_xlen_t from, R_xlen_t to){
   rexp::REXP out;
   out.set_rclass(rexp::REXP_RClass_COMPLEX);
-  for(int i = 0; i < x.length(); i++){
+  for(R_xlen_t i = from; i < to; i++){
     rexp::CMPLX *val = out.add_complexvalue();
     val->set_real(x[i].r);
     val->set_imag(x[i].i);
@@ -86,13 +138,13 @@ rexp::REXP rexp_complex(Rcpp::ComplexVector x){
 }
 
 //needed by rexp_list
-rexp::REXP rexp_object(Rcpp::RObject x, bool skip_native);
+rexp::REXP rexp_object(Rcpp::RObject x, bool skip_native, bool compact);
 
-rexp::REXP rexp_list(Rcpp::List x, bool skip_native){
+rexp::REXP rexp_list(Rcpp::List x, bool skip_native, bool compact){
   rexp::REXP out;
   out.set_rclass(rexp::REXP_RClass_LIST);
-  for(int i = 0; i < x.length(); i++){
-    rexp::REXP obj = rexp_object(x[i], skip_native);
+  for(R_xlen_t i = 0; i < x.length(); i++){
+    rexp::REXP obj = rexp_object(x[i], skip_native, compact);
     out.add_rexpvalue()->CopyFrom(obj);
   }
   return out;
@@ -104,32 +156,45 @@ rexp::REXP rexp_null(){
   return out;
 }
 
+rexp::REXP rexp_vector(SEXP x, R_xlen_t from, R_xlen_t to, bool compact){
+  switch(TYPEOF(x)){
+    case LGLSXP: return compact ? rexp_bool_bits(x, from, to) : rexp_bool(x, from, to);
+    case INTSXP: return rexp_int(x, from, to);
+    case REALSXP: return rexp_real(x, from, to);
+    case CPLXSXP: return rexp_complex(x, from, to);
+    case STRSXP: return compact ? rexp_string_dict(x, from, to) : rexp_string(x, from, to);
+    case RAWSXP: return rexp_raw(x, from, to);
+    default: throw std::runtime_error("Not an atomic vector");
+  }
+}
+
 // see also
 // http://gallery.rcpp.org/articles/rcpp-wrap-and-recurse/
 // http://statr.me/rcpp-note/api/RObject.html
 // can we do this with RObject instead of SEXP ?
-rexp::REXP rexp_any(Rcpp::RObject x, bool skip_native){
+rexp::REXP rexp_any(Rcpp::RObject x, bool skip_native, bool compact){
   switch(TYPEOF(x)){
     case NILSXP: return rexp_null();
-    case LGLSXP: return rexp_bool(Rcpp::as<Rcpp::LogicalVector>(x));
-    case INTSXP: return rexp_int(Rcpp::as<Rcpp::IntegerVector>(x));
-    case REALSXP: return rexp_real(Rcpp::as<Rcpp::NumericVector>(x));
-    case CPLXSXP: return rexp_complex(Rcpp::as<Rcpp::ComplexVector>(x));
-    case STRSXP: return rexp_string(Rcpp::as<Rcpp::StringVector>(x));
-    case VECSXP: return rexp_list(Rcpp::as<Rcpp::List>(x), skip_native);
-    case RAWSXP: return rexp_raw(Rcpp::as<Rcpp::RawVector>(x));
+    case LGLSXP:
+    case INTSXP:
+    case REALSXP:
+    case CPLXSXP:
+    case STRSXP:
+    case RAWSXP: return rexp_vector(x, 0, Rf_xlength(x), compact);
+    case VECSXP: return rexp_list(Rcpp::as<Rcpp::List>(x), skip_native, compact);
     default: return rexp_native(x, skip_native);
   }
 }
 
-rexp::REXP rexp_object(Rcpp::RObject x, bool skip_native){
-  rexp::REXP out = rexp_any(x, skip_native);
+rexp::REXP rexp_object(Rcpp::RObject x, bool skip_native, bool compact){
+  rexp::REXP out = rexp_any(x, skip_native, compact);
+  stats_items(1);
   if(out.rclass() != rexp::REXP_RClass_NATIVE){
     std::vector< std::string > attr_names = x.attributeNames();
     int len = attr_names.size();
     for(int i = 0; i < len; i++) {
       std::string name = attr_names[i];
-      rexp::REXP attr = rexp_object(x.attr(name), skip_native);
+      rexp::REXP attr = rexp_object(x.attr(name), skip_native, compact);
       out.add_attrname()->assign(name);
       out.add_attrvalue()->CopyFrom(attr);
     }
@@ -138,14 +203,21 @@ rexp::REXP rexp_object(Rcpp::RObject x, bool skip_native){
 }
 
 // [[Rcpp::export]]
-Rcpp::RawVector cpp_serialize_pb(Rcpp::RObject x, bool skip_native){
-  rexp::REXP message = rexp_object(x, skip_native);
+Rcpp::RawVector cpp_serialize_pb(Rcpp::RObject x, bool skip_native, bool compact){
+  stats_call stats("cpp_serialize_pb", 0);
+  stats_phase materialize(PHASE_MATERIALIZE);
+  rexp::REXP message = rexp_object(x, skip_native, compact);
+  stats_phase parse(PHASE_PARSE);
 #ifdef USENEWAPI
-  long size = message.ByteSizeLong();
+  size_t size = message.ByteSizeLong();
 #else
-  int size = message.ByteSize();
+  size_t size = message.ByteSize();
 #endif
+  if(size > INT_MAX)
+    throw std::runtime_error("Object exceeds the 2GB limit of a protobuf message, use serialize_pb(segment_size = ...)");
   Rcpp::RawVector res(size);
+  stats_bytes(size);
+  stats_est_alloc(1);
   if(!message.SerializeToArray(res.begin(), size))
     throw std::runtime_error("Failed to serialize into protobuf message");
   return res;
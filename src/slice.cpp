@@ -0,0 +1,354 @@
+#include "rexp.pb.h"
+#include "wire.h"
+#include "stats.h"
+#include <Rcpp.h>
+
+// Partial reads from a serialized list or data frame. The top-level REXP is
+// scanned at the wire level: unwanted rexpValue elements are skipped by length,
+// and for the selected columns only the requested rows are decoded.
+
+//from unserialize.cpp
+Rcpp::RObject unrexp_object(const rexp::REXP &message);
+
+// Field numbers from rexp.proto
+#define REXP_RCLASS 1
+#define REXP_REALVALUE 2
+#define REXP_INTVALUE 3
+#define REXP_BOOLEANVALUE 4
+#define REXP_STRINGVALUE 5
+#define REXP_RAWVALUE 6
+#define REXP_COMPLEXVALUE 7
+#define REXP_REXPVALUE 8
+#define REXP_ATTRNAME 11
+#define REXP_ATTRVALUE 12
+#define REXP_STRINGDICT 14
+#define REXP_STRINGINDEX 15
+#define REXP_BOOLEANBITS 16
+#define REXP_BOOLEANNA 17
+#define REXP_LENGTH 18
+
+// Fields of one (sub)message that we need for slicing
+struct rexp_fields {
+  int rclass;
+  std::vector<wire_span> blocks;   // packed or fixed64 data blocks
+  std::vector<int> values;         // decoded varints (only up to 'need')
+  std::vector<wire_span> elements; // submessages (only up to 'need')
+  std::vector<wire_span> dict;     // strings of the compact profile
+  wire_span bits;
+  wire_span na;
+  uint64_t length;
+  std::vector<std::string> attr_names;
+  std::vector<wire_span> attr_values;
+};
+
+static Rcpp::RObject decode_span(wire_span span){
+  rexp::REXP message;
+  if(!message.ParseFromArray(span.data, span.size))
+    throw std::runtime_error("Failed to parse protobuf message");
+  return unrexp_object(message);
+}
+
+static void read_varints(wire_reader &in, std::vector<int> &out, size_t need){
+  if(in.type == WIRE_LENGTH){
+    wire_reader packed(in.bytes());
+    while(!packed.done() && out.size() < need)
+      out.push_back(packed.varint());
+  } else {
+    uint64_t val = in.varint();
+    if(out.size() < need)
+      out.push_back(val);
+  }
+}
+
+// Scans a REXP and keeps at most 'need' values of the repeated fields
+static rexp_fields scan_rexp(wire_span span, size_t need){
+  rexp_fields out;
+  out.rclass = -1;
+  out.bits.size = out.na.size = 0;
+  out.length = 0;
+  wire_reader in(span);
+  while(in.next()){
+    switch(in.field){
+    case REXP_RCLASS:
+      out.rclass = in.varint();
+      break;
+    case REXP_REALVALUE:
+      if(in.type == WIRE_LENGTH){
+        out.blocks.push_back(in.bytes());
+      } else {
+        wire_span val = {in.pos, 8};
+        in.fixed64();
+        out.blocks.push_back(val);
+      }
+      break;
+    case REXP_INTVALUE:
+    case REXP_BOOLEANVALUE:
+    case REXP_STRINGINDEX:
+      read_varints(in, out.values, need);
+      break;
+    case REXP_STRINGDICT:
+      out.dict.push_back(in.bytes());
+      break;
+    case REXP_BOOLEANBITS:
+      out.bits = in.bytes();
+      break;
+    case REXP_BOOLEANNA:
+      out.na = in.bytes();
+      break;
+    case REXP_LENGTH:
+      out.length = in.varint();
+      break;
+    case REXP_RAWVALUE:
+      out.blocks.push_back(in.bytes());
+      break;
+    case REXP_STRINGVALUE:
+    case REXP_COMPLEXVALUE:
+    case REXP_REXPVALUE:
+      if(out.elements.size() < need){
+        out.elements.push_back(in.bytes());
+      } else {
+        in.skip();
+      }
+      break;
+    case REXP_ATTRNAME: {
+      wire_span str = in.bytes();
+      out.attr_names.push_back(std::string((const char*) str.data, str.size));
+      break;
+    }
+    case REXP_ATTRVALUE:
+      out.attr_values.push_back(in.bytes());
+      break;
+    default:
+      in.skip();
+    }
+  }
+  if(out.rclass < 0)
+    throw std::runtime_error("Protobuf message does not have an rclass");
+  if(out.attr_names.size() != out.attr_values.size())
+    throw std::runtime_error("Protobuf message has unequal number of attribute names and values");
+  return out;
+}
+
+// Element i of the values stored in (possibly multiple) packed blocks
+static const uint8_t * block_at(const std::vector<wire_span> &blocks, size_t i, size_t width){
+  size_t offset = i * width;
+  for(size_t b = 0; b < blocks.size(); b++){
+    if(offset < blocks[b].size)
+      return blocks[b].data + offset;
+    offset -= blocks[b].size;
+  }
+  throw std::runtime_error("Row index out of bounds");
+}
+
+static void check_row(size_t row, size_t len){
+  if(row >= len)
+    throw std::runtime_error("Row index out of bounds");
+}
+
+static Rcpp::RObject slice_vector(wire_span span, Rcpp::IntegerVector rows);
+
+static Rcpp::RObject slice_values(const rexp_fields &msg, Rcpp::IntegerVector rows){
+  int n = rows.length();
+  stats_items(1);
+  stats_est_alloc(1);
+  switch(msg.rclass){
+  case rexp::REXP_RClass_REAL: {
+    Rcpp::NumericVector out(n);
+    for(int i = 0; i < n; i++)
+      memcpy(&out[i], block_at(msg.blocks, rows[i] - 1, 8), 8);
+    return out;
+  }
+  case rexp::REXP_RClass_INTEGER: {
+    Rcpp::IntegerVector out(n);
+    for(int i = 0; i < n; i++){
+      check_row(rows[i] - 1, msg.values.size());
+      out[i] = zigzag32(msg.values[rows[i] - 1]);
+    }
+    return out;
+  }
+  case rexp::REXP_RClass_LOGICAL: {
+    Rcpp::LogicalVector out(n);
+    for(int i = 0; i < n; i++){
+      check_row(rows[i] - 1, msg.values.size());
+      int val = msg.values[rows[i] - 1];
+      out[i] = (val == rexp::REXP_RBOOLEAN_NA) ? NA_LOGICAL : val;
+    }
+    return out;
+  }
+  case rexp::REXP_RClass_LOGICALBITS: {
+    Rcpp::LogicalVector out(n);
+    for(int i = 0; i < n; i++){
+      size_t row = rows[i] - 1;
+      check_row(row, msg.length);
+      check_row(row / 8, msg.bits.size);
+      if(row / 8 < msg.na.size && (msg.na.data[row / 8] >> (row % 8)) & 1){
+        out[i] = NA_LOGICAL;
+      } else {
+        out[i] = (msg.bits.data[row / 8] >> (row % 8)) & 1;
+      }
+    }
+    return out;
+  }
+  case rexp::REXP_RClass_STRINGDICT: {
+    Rcpp::StringVector out(n);
+    for(int i = 0; i < n; i++){
+      check_row(rows[i] - 1, msg.values.size());
+      uint32_t index = msg.values[rows[i] - 1];
+      if(index > msg.dict.size())
+        throw std::runtime_error("String index out of bounds");
+      if(index == 0){
+        SET_STRING_ELT(out, i, NA_STRING);
+      } else {
+        wire_span str = msg.dict[index - 1];
+        SET_STRING_ELT(out, i, Rf_mkCharLenCE((const char*) str.data, str.size, CE_UTF8));
+      }
+    }
+    return out;
+  }
+  case rexp::REXP_RClass_RAW: {
+    Rcpp::RawVector out(n);
+    for(int i = 0; i < n; i++)
+      out[i] = *block_at(msg.blocks, rows[i] - 1, 1);
+    return out;
+  }
+  case rexp::REXP_RClass_STRING: {
+    Rcpp::StringVector out(n);
+    for(int i = 0; i < n; i++){
+      check_row(rows[i] - 1, msg.elements.size());
+      rexp::STRING val;
+      wire_span el = msg.elements[rows[i] - 1];
+      if(!val.ParseFromArray(el.data, el.size))
+        throw std::runtime_error("Failed to parse protobuf message");
+      if(val.isna()){
+        out[i] = NA_STRING;
+      } else {
+        Rcpp::String str(val.strval());
+        str.set_encoding(CE_UTF8);
+        out[i] = str;
+      }
+    }
+    return out;
+  }
+  case rexp::REXP_RClass_COMPLEX: {
+    Rcpp::ComplexVector out(n);
+    for(int i = 0; i < n; i++){
+      check_row(rows[i] - 1, msg.elements.size());
+      rexp::CMPLX val;
+      wire_span el = msg.elements[rows[i] - 1];
+      if(!val.ParseFromArray(el.data, el.size))
+        throw std::runtime_error("Failed to parse protobuf message");
+      out[i].r = val.real();
+      out[i].i = val.imag();
+    }
+    return out;
+  }
+  case rexp::REXP_RClass_LIST: {
+    Rcpp::List out(n);
+    for(int i = 0; i < n; i++){
+      check_row(rows[i] - 1, msg.elements.size());
+      out[i] = decode_span(msg.elements[rows[i] - 1]);
+    }
+    return out;
+  }
+  case rexp::REXP_RClass_NULLTYPE:
+    if(n > 0)
+      throw std::runtime_error("Row index out of bounds");
+    return R_NilValue;
+  }
+  throw std::runtime_error("Cannot select rows from a native object");
+}
+
+static Rcpp::RObject slice_vector(wire_span span, Rcpp::IntegerVector rows){
+  size_t need = rows.length() ? *std::max_element(rows.begin(), rows.end()) : 0;
+  rexp_fields msg = scan_rexp(span, need);
+  Rcpp::RObject object = slice_values(msg, rows);
+  for(size_t i = 0; i < msg.attr_names.size(); i++){
+    std::string name = msg.attr_names[i];
+    if(name == "names"){
+      object.attr(name) = slice_vector(msg.attr_values[i], rows);
+    } else if(name == "dim"){
+      throw std::runtime_error("Cannot select rows from a matrix or array column");
+    } else {
+      object.attr(name) = decode_span(msg.attr_values[i]);
+    }
+  }
+  return object;
+}
+
+// Row names may be stored in compact form c(NA, -n)
+static Rcpp::RObject slice_row_names(wire_span span, Rcpp::IntegerVector rows){
+  rexp_fields msg = scan_rexp(span, 3);
+  if(msg.rclass == rexp::REXP_RClass_INTEGER && msg.values.size() == 2 &&
+     zigzag32(msg.values[0]) == NA_INTEGER){
+    return Rcpp::IntegerVector(rows.begin(), rows.end());
+  }
+  return slice_vector(span, rows);
+}
+
+static std::vector<int> match_columns(Rcpp::RObject columns, Rcpp::StringVector names, size_t n){
+  std::vector<int> out;
+  if(columns.isNULL()){
+    for(size_t i = 0; i < n; i++)
+      out.push_back(i);
+  } else if(TYPEOF(columns) == STRSXP){
+    Rcpp::StringVector cols(columns);
+    for(int i = 0; i < cols.length(); i++){
+      std::string col(cols[i]);
+      int j = 0;
+      while(j < names.length() && col != std::string(names[j]))
+        j++;
+      if(j == names.length())
+        throw std::runtime_error("Column not found: " + col);
+      out.push_back(j);
+    }
+  } else {
+    Rcpp::IntegerVector cols(columns);
+    for(int i = 0; i < cols.length(); i++){
+      if(cols[i] < 1 || (size_t) cols[i] > n)
+        throw std::runtime_error("Column index out of bounds");
+      out.push_back(cols[i] - 1);
+    }
+  }
+  return out;
+}
+
+// [[Rcpp::export]]
+Rcpp::RObject cpp_unserialize_pb_slice(Rcpp::RawVector x, Rcpp::RObject columns, Rcpp::RObject rows){
+  stats_call stats("cpp_unserialize_pb_slice", x.size());
+  stats_phase phase(PHASE_MATERIALIZE);
+  wire_span span = {x.begin(), (size_t) x.size()};
+  rexp_fields msg = scan_rexp(span, SIZE_MAX);
+  Rcpp::IntegerVector idx;
+  if(!rows.isNULL())
+    idx = Rcpp::IntegerVector(rows);
+  if(msg.rclass != rexp::REXP_RClass_LIST){
+    if(!columns.isNULL())
+      throw std::runtime_error("Columns can only be selected from a list or data frame");
+    return rows.isNULL() ? decode_span(span) : slice_vector(span, idx);
+  }
+  Rcpp::StringVector names;
+  for(size_t i = 0; i < msg.attr_names.size(); i++){
+    if(msg.attr_names[i] == "names")
+      names = decode_span(msg.attr_values[i]);
+  }
+  std::vector<int> selected = match_columns(columns, names, msg.elements.size());
+  Rcpp::List out(selected.size());
+  for(size_t i = 0; i < selected.size(); i++){
+    wire_span el = msg.elements.at(selected[i]);
+    out[i] = rows.isNULL() ? decode_span(el) : slice_vector(el, idx);
+  }
+  for(size_t i = 0; i < msg.attr_names.size(); i++){
+    std::string name = msg.attr_names[i];
+    if(name == "names"){
+      Rcpp::StringVector subset(selected.size());
+      for(size_t j = 0; j < selected.size(); j++)
+        subset[j] = names[selected[j]];
+      out.attr(name) = subset;
+    } else if(name == "row.names" && !rows.isNULL()){
+      out.attr(name) = slice_row_names(msg.attr_values[i], idx);
+    } else {
+      out.attr(name) = decode_span(msg.attr_values[i]);
+    }
+  }
+  return out;
+}
@@ -0,0 +1,77 @@
+#include "stats.h"
+#include <Rcpp.h>
+#include <map>
+#include <string>
+
+bool stats_enabled = false;
+stats_entry *stats_current = NULL;
+
+static std::map<std::string, stats_entry> entries;
+static int current_phase = PHASE_OTHER;
+static std::chrono::steady_clock::time_point phase_start;
+
+stats_entry *stats_lookup(const char *name){
+  std::map<std::string, stats_entry>::iterator it = entries.find(name);
+  if(it == entries.end()){
+    stats_entry empty = {};
+    it = entries.insert(std::make_pair(std::string(name), empty)).first;
+  }
+  return &it->second;
+}
+
+// Adds the time since the last switch to the current phase, returns the old phase
+int stats_switch(int phase){
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  int prev = current_phase;
+  if(stats_current)
+    stats_current->seconds[prev] += std::chrono::duration<double>(now - phase_start).count();
+  phase_start = now;
+  current_phase = phase;
+  return prev;
+}
+
+// [[Rcpp::export]]
+bool cpp_stats_enable(bool enable){
+  bool prev = stats_enabled;
+  stats_enabled = enable;
+  return prev;
+}
+
+// [[Rcpp::export]]
+void cpp_stats_reset(){
+  entries.clear();
+}
+
+// [[Rcpp::export]]
+Rcpp::List cpp_stats_get(){
+  size_t n = entries.size();
+  Rcpp::CharacterVector name(n);
+  Rcpp::NumericVector calls(n), bytes(n), items(n), est_allocs(n), callbacks(n);
+  Rcpp::NumericVector parse(n), materialize(n), callback(n), total(n);
+  size_t i = 0;
+  for(std::map<std::string, stats_entry>::iterator it = entries.begin(); it != entries.end(); it++, i++){
+    stats_entry val = it->second;
+    name[i] = it->first;
+    calls[i] = val.calls;
+    bytes[i] = val.bytes;
+    items[i] = val.items;
+    est_allocs[i] = val.est_allocs;
+    callbacks[i] = val.callbacks;
+    parse[i] = val.seconds[PHASE_PARSE];
+    materialize[i] = val.seconds[PHASE_MATERIALIZE];
+    callback[i] = val.seconds[PHASE_CALLBACK];
+    total[i] = val.total;
+  }
+  return Rcpp::List::create(
+    Rcpp::_["entry"] = name,
+    Rcpp::_["calls"] = calls,
+    Rcpp::_["bytes"] = bytes,
+    Rcpp::_["items"] = items,
+    Rcpp::_["est_allocs"] = est_allocs,
+    Rcpp::_["callbacks"] = callbacks,
+    Rcpp::_["parse"] = parse,
+    Rcpp::_["materialize"] = materialize,
+    Rcpp::_["callback"] = callback,
+    Rcpp::_["total"] = total
+  );
+}
@@ -0,0 +1,98 @@
+#ifndef PROTOLITE_STATS_H
+#define PROTOLITE_STATS_H
+
+// Opt-in instrumentation of the cpp_* entry points, see protolite_stats().
+// Counters are only updated inside an active stats_call, so when stats are
+// disabled each hook below costs a single branch. Phases are switched once per
+// entry point and around each callback into R, never per element: a callback
+// costs far more than the two clock reads it takes to time it.
+
+#include <chrono>
+#include <stddef.h>
+
+enum stats_phase_id {
+  PHASE_OTHER = 0,
+  PHASE_PARSE,        // protobuf parsing/serializing and wire scanning
+  PHASE_MATERIALIZE,  // converting between R objects and messages
+  PHASE_CALLBACK,     // calls back into R: make_json, parse_json, (un)serialize
+  N_PHASES
+};
+
+struct stats_entry {
+  double calls;
+  double bytes;
+  double items;
+  double est_allocs;
+  double callbacks;
+  double seconds[N_PHASES];
+  double total;
+};
+
+extern bool stats_enabled;
+extern stats_entry *stats_current;
+
+stats_entry *stats_lookup(const char *name);
+int stats_switch(int phase);
+
+// Scope of one entry point call
+class stats_call {
+public:
+  stats_call(const char *name, size_t bytes) : active(stats_enabled), prev(stats_current), phase(PHASE_OTHER) {
+    if(!active)
+      return;
+    start = std::chrono::steady_clock::now();
+    phase = stats_switch(PHASE_OTHER);
+    stats_current = stats_lookup(name);
+    stats_current->calls++;
+    stats_current->bytes += bytes;
+  }
+  ~stats_call(){
+    if(active){
+      stats_switch(phase);
+      stats_current->total += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      stats_current = prev;
+    }
+  }
+private:
+  bool active;
+  stats_entry *prev;
+  int phase;
+  std::chrono::steady_clock::time_point start;
+};
+
+// Attributes the time within a scope to a phase (exclusive of nested phases)
+class stats_phase {
+public:
+  stats_phase(int phase) : prev(-1) {
+    if(stats_current){
+      prev = stats_switch(phase);
+      if(phase == PHASE_CALLBACK)
+        stats_current->callbacks++;
+    }
+  }
+  ~stats_phase(){
+    if(stats_current && prev >= 0)
+      stats_switch(prev);
+  }
+private:
+  int prev;
+};
+
+static inline void stats_bytes(double n){
+  if(stats_current)
+    stats_current->bytes += n;
+}
+
+static inline void stats_items(double n){
+  if(stats_current)
+    stats_current->items += n;
+}
+
+// Estimated number of R vectors, counted per object/feature/geometry rather
+// than per actual allocation
+static inline void stats_est_alloc(double n){
+  if(stats_current)
+    stats_current->est_allocs += n;
+}
+
+#endif
@@ -0,0 +1,595 @@
+#include "geobuf.pb.h"
+#include "mvt.pb.h"
+#include "stats.h"
+#include "wire.h"
+#include <Rcpp.h>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <unordered_map>
+
+/* Conversion between geobuf and mapbox vector tiles without creating R objects.
+ * Geobuf coordinates are lon/lat (EPSG:4326), which are projected onto the tile
+ * z/x/y (EPSG:3857) and quantized to the tile extent, or the other way around.
+ * Keys and values are remapped between the tables of both formats. */
+
+#define MoveTo 1
+#define LineTo 2
+#define ClosePath 7
+
+typedef geobuf::Data::Geometry GeobufGeometry;
+
+struct point {
+  double x;
+  double y;
+};
+
+typedef std::vector<point> ring;
+
+// A feature geometry as a list of polygons, each a list of rings. Lines are
+// polygons with a single ring, and points are a single ring with all points.
+typedef std::vector<std::vector<ring>> parts;
+
+// Position of a tile in the world, in units of tiles at zoom level z
+struct tile_position {
+  double x;
+  double y;
+  double n;
+};
+
+static tile_position make_tile(Rcpp::NumericVector zxy){
+  if(zxy.size() != 3)
+    throw std::runtime_error("zxy must have length 3");
+  tile_position out = {zxy[1], zxy[2], pow(2.0, zxy[0])};
+  return out;
+}
+
+static double ring_area(const ring &x){
+  double sum = 0;
+  for(size_t i = 0; i < x.size(); i++){
+    const point &a = x[i];
+    const point &b = x[(i + 1) % x.size()];
+    sum += a.x * b.y - b.x * a.y;
+  }
+  return sum / 2;
+}
+
+/* Geobuf to MVT */
+
+static uint32_t cmd_integer(int cmd, size_t count){
+  if(count > (1 << 29) - 1)
+    throw std::runtime_error("Too many vertices in vector tile feature");
+  return (cmd & 0x7) | (count << 3);
+}
+
+static uint32_t zigzag_param(int64_t val){
+  if(val > INT_MAX || val < INT_MIN)
+    throw std::runtime_error("Coordinates are out of range for the vector tile");
+  return ((uint32_t) val << 1) ^ (uint32_t) (val >> 31);
+}
+
+// Decodes 'npoints' delta encoded points, starting at 'offset' in the coordinates
+static ring geobuf_ring(const GeobufGeometry &geom, size_t &offset, size_t npoints, uint32_t dim, double multiplier){
+  if(npoints > (geom.coords_size() - offset) / dim)
+    throw std::runtime_error("Geometry lengths exceed number of coordinates");
+  ring out(npoints);
+  int64_t x = 0;
+  int64_t y = 0;
+  for(size_t i = 0; i < npoints; i++){
+    x += geom.coords(offset);
+    y += geom.coords(offset + 1);
+    out[i].x = x / multiplier;
+    out[i].y = y / multiplier;
+    offset += dim;
+  }
+  return out;
+}
+
+static parts geobuf_parts(const GeobufGeometry &geom, uint32_t dim, double multiplier){
+  if(dim < 2)
+    throw std::runtime_error("Geobuf coordinates must have at least 2 dimensions");
+  parts out;
+  size_t offset = 0;
+  size_t total = geom.coords_size() / dim;
+  switch(geom.type()){
+  case geobuf::Data_Geometry_Type_POINT:
+  case geobuf::Data_Geometry_Type_MULTIPOINT:
+  case geobuf::Data_Geometry_Type_LINESTRING:
+    out.push_back(std::vector<ring>(1, geobuf_ring(geom, offset, total, dim, multiplier)));
+    break;
+  case geobuf::Data_Geometry_Type_MULTILINESTRING:
+  case geobuf::Data_Geometry_Type_POLYGON: {
+    bool multi = geom.type() == geobuf::Data_Geometry_Type_MULTILINESTRING;
+    if(!geom.lengths_size()){
+      out.push_back(std::vector<ring>(1, geobuf_ring(geom, offset, total, dim, multiplier)));
+      break;
+    }
+    if(!multi)
+      out.resize(1);
+    for(int i = 0; i < geom.lengths_size(); i++){
+      ring x = geobuf_ring(geom, offset, geom.lengths(i), dim, multiplier);
+      if(multi){
+        out.push_back(std::vector<ring>(1, x));
+      } else {
+        out[0].push_back(x);
+      }
+    }
+    break;
+  }
+  case geobuf::Data_Geometry_Type_MULTIPOLYGON: {
+    if(!geom.lengths_size()){
+      out.push_back(std::vector<ring>(1, geobuf_ring(geom, offset, total, dim, multiplier)));
+      break;
+    }
+    int cursor = 0;
+    auto next_length = [&](){
+      if(cursor >= geom.lengths_size())
+        throw std::runtime_error("Geometry lengths exceed number of coordinates");
+      return (size_t) geom.lengths(cursor++);
+    };
+    size_t npolygons = next_length();
+    for(size_t i = 0; i < npolygons; i++){
+      size_t nrings = next_length();
+      std::vector<ring> polygon;
+      for(size_t j = 0; j < nrings; j++)
+        polygon.push_back(geobuf_ring(geom, offset, next_length(), dim, multiplier));
+      out.push_back(polygon);
+    }
+    break;
+  }
+  case geobuf::Data_Geometry_Type_GEOMETRYCOLLECTION:
+    break;
+  }
+  return out;
+}
+
+// String ids that mvt2geobuf() wrote for ids above INT64_MAX
+static bool parse_uint64(const std::string &str, uint64_t *out){
+  if(str.empty() || str.size() > 20 || str.find_first_not_of("0123456789") != std::string::npos)
+    return false;
+  errno = 0;
+  *out = strtoull(str.c_str(), NULL, 10);
+  return errno == 0 && std::to_string(*out) == str;
+}
+
+class mvt_encoder {
+public:
+  vector_tile::Tile::Layer *layer;
+  size_t skipped;
+
+  mvt_encoder(vector_tile::Tile::Layer *layer, tile_position tile, uint32_t extent) :
+    layer(layer), skipped(0), tile(tile), extent(extent) {}
+
+  void feature(const geobuf::Data &data, const geobuf::Data::Feature &x){
+    vector_tile::Tile::Feature out;
+    stats_items(1);
+    if(!geometry(x.geometry(), data.dimensions(), pow(10.0, data.precision()), out))
+      return;
+    uint64_t id;
+    if(x.has_int_id() && x.int_id() >= 0)
+      out.set_id(x.int_id());
+    else if(x.has_id() && parse_uint64(x.id(), &id))
+      out.set_id(id);
+    for(int i = 0; i + 1 < x.properties_size(); i += 2){
+      uint32_t key = x.properties(i);
+      uint32_t val = x.properties(i + 1);
+      if((int) key >= data.keys_size() || (int) val >= x.values_size())
+        throw std::runtime_error("Property index out of bounds");
+      out.add_tags(key_index(data.keys(key)));
+      out.add_tags(value_index(x.values(val)));
+    }
+    layer->add_features()->Swap(&out);
+  }
+
+private:
+  tile_position tile;
+  uint32_t extent;
+  int64_t cursor[2];
+  std::unordered_map<std::string, uint32_t> keys;
+  std::unordered_map<std::string, uint32_t> values;
+
+  uint32_t key_index(const std::string &key){
+    std::unordered_map<std::string, uint32_t>::iterator it = keys.find(key);
+    if(it != keys.end())
+      return it->second;
+    uint32_t index = keys.size();
+    layer->add_keys(key);
+    keys[key] = index;
+    return index;
+  }
+
+  uint32_t value_index(const geobuf::Data::Value &x){
+    vector_tile::Tile::Value val;
+    if(x.has_string_value()){
+      val.set_string_value(x.string_value());
+    } else if(x.has_double_value()){
+      val.set_double_value(x.double_value());
+    } else if(x.has_pos_int_value()){
+      val.set_uint_value(x.pos_int_value());
+    } else if(x.has_neg_int_value()){
+      val.set_sint_value(-(int64_t) x.neg_int_value());
+    } else if(x.has_bool_value()){
+      val.set_bool_value(x.bool_value());
+    } else if(x.has_json_value()){
+      val.set_string_value(x.json_value());
+    } else {
+      throw std::runtime_error("Empty property value");
+    }
+    std::string bytes = val.SerializeAsString();
+    std::unordered_map<std::string, uint32_t>::iterator it = values.find(bytes);
+    if(it != values.end())
+      return it->second;
+    uint32_t index = values.size();
+    layer->add_values()->Swap(&val);
+    values[bytes] = index;
+    return index;
+  }
+
+  // Projects lon/lat onto the tile, and drops repeated points. Latitudes are
+  // limited to the range of web mercator.
+  ring quantize(const ring &x){
+    ring out;
+    for(size_t i = 0; i < x.size(); i++){
+      double lat = std::max(-85.0511287798, std::min(85.0511287798, x[i].y)) * M_PI / 180;
+      point p = {
+        round(((x[i].x + 180) / 360 * tile.n - tile.x) * extent),
+        round(((1 - asinh(tan(lat)) / M_PI) / 2 * tile.n - tile.y) * extent)
+      };
+      if(out.empty() || p.x != out.back().x || p.y != out.back().y)
+        out.push_back(p);
+    }
+    return out;
+  }
+
+  void move(vector_tile::Tile::Feature &out, const point &p){
+    out.add_geometry(zigzag_param((int64_t) p.x - cursor[0]));
+    out.add_geometry(zigzag_param((int64_t) p.y - cursor[1]));
+    cursor[0] = p.x;
+    cursor[1] = p.y;
+  }
+
+  void line(vector_tile::Tile::Feature &out, const ring &x){
+    out.add_geometry(cmd_integer(MoveTo, 1));
+    move(out, x[0]);
+    out.add_geometry(cmd_integer(LineTo, x.size() - 1));
+    for(size_t i = 1; i < x.size(); i++)
+      move(out, x[i]);
+  }
+
+  // Returns false if nothing is left of the geometry after quantization
+  bool geometry(const GeobufGeometry &geom, uint32_t dim, double multiplier, vector_tile::Tile::Feature &out){
+    parts data = geobuf_parts(geom, dim, multiplier);
+    cursor[0] = cursor[1] = 0;
+    switch(geom.type()){
+    case geobuf::Data_Geometry_Type_POINT:
+    case geobuf::Data_Geometry_Type_MULTIPOINT: {
+      out.set_type(vector_tile::Tile::POINT);
+      const ring &points = data.at(0).at(0);
+      if(points.empty())
+        return false;
+      out.add_geometry(cmd_integer(MoveTo, points.size()));
+      for(size_t i = 0; i < points.size(); i++){
+        ring p = quantize(ring(1, points[i]));
+        move(out, p[0]);
+      }
+      break;
+    }
+    case geobuf::Data_Geometry_Type_LINESTRING:
+    case geobuf::Data_Geometry_Type_MULTILINESTRING:
+      out.set_type(vector_tile::Tile::LINESTRING);
+      for(size_t i = 0; i < data.size(); i++){
+        ring x = quantize(data[i].at(0));
+        if(x.size() > 1)
+          line(out, x);
+      }
+      break;
+    case geobuf::Data_Geometry_Type_POLYGON:
+    case geobuf::Data_Geometry_Type_MULTIPOLYGON:
+      out.set_type(vector_tile::Tile::POLYGON);
+      for(size_t i = 0; i < data.size(); i++){
+        for(size_t j = 0; j < data[i].size(); j++){
+          ring x = quantize(data[i][j]);
+          if(x.size() > 1 && x.front().x == x.back().x && x.front().y == x.back().y)
+            x.pop_back();
+          double area = x.size() > 2 ? ring_area(x) : 0;
+          if(area == 0){
+            // Without an exterior ring, the holes are dropped as well
+            if(j == 0)
+              break;
+            continue;
+          }
+          // Exterior rings have a positive area in tile coordinates, holes negative
+          if((j == 0) != (area > 0))
+            std::reverse(x.begin(), x.end());
+          line(out, x);
+          out.add_geometry(cmd_integer(ClosePath, 1));
+        }
+      }
+      break;
+    case geobuf::Data_Geometry_Type_GEOMETRYCOLLECTION:
+      // A vector tile feature has a single geometry type
+      skipped++;
+      return false;
+    }
+    return out.geometry_size() > 0;
+  }
+};
+
+// [[Rcpp::export]]
+Rcpp::RawVector cpp_geobuf2mvt(Rcpp::RawVector x, Rcpp::NumericVector zxy, int extent, std::string name){
+  stats_call stats("cpp_geobuf2mvt", x.size());
+  if(extent < 1)
+    throw std::runtime_error("Extent must be between 1 and 2^31 - 1");
+  tile_position tile = make_tile(zxy);
+  geobuf::Data data;
+  {
+    stats_phase phase(PHASE_PARSE);
+    if(x.size() > INT_MAX || !data.ParseFromArray(x.begin(), x.size()))
+      throw std::runtime_error("Failed to parse geobuf proto message");
+  }
+  stats_phase phase(PHASE_MATERIALIZE);
+  vector_tile::Tile message;
+  vector_tile::Tile::Layer *layer = message.add_layers();
+  layer->set_version(2);
+  layer->set_name(name);
+  layer->set_extent(extent);
+  mvt_encoder encoder(layer, tile, extent);
+  if(data.has_feature_collection()){
+    const geobuf::Data::FeatureCollection &collection = data.feature_collection();
+    for(int i = 0; i < collection.features_size(); i++)
+      encoder.feature(data, collection.features(i));
+  } else if(data.has_feature()){
+    encoder.feature(data, data.feature());
+  } else if(data.has_geometry()){
+    geobuf::Data::Feature feature;
+    feature.mutable_geometry()->CopyFrom(data.geometry());
+    encoder.feature(data, feature);
+  } else {
+    throw std::runtime_error("No 'data_type' field set");
+  }
+  if(encoder.skipped)
+    Rcpp::warning("Skipped %d features with a GeometryCollection", (int) encoder.skipped);
+  stats_phase parse(PHASE_PARSE);
+#ifdef USENEWAPI
+  size_t size = message.ByteSizeLong();
+#else
+  size_t size = message.ByteSize();
+#endif
+  Rcpp::RawVector res(size);
+  stats_bytes(size);
+  stats_est_alloc(1);
+  if(!message.SerializeToArray(res.begin(), size))
+    throw std::runtime_error("Failed to serialize into vector tile message");
+  return res;
+}
+
+/* MVT to geobuf */
+
+// Decodes the geometry commands into rings in tile coordinates. For polygons
+// each ClosePath ends a ring, for lines each MoveTo starts a new line, and
+// points are all collected in a single ring.
+static std::vector<ring> mvt_rings(const vector_tile::Tile::Feature &feature){
+  std::vector<ring> out;
+  int64_t pos[2] = {0, 0};
+  bool points = feature.type() == vector_tile::Tile::POINT;
+  size_t n = feature.geometry_size();
+  for(size_t i = 0; i < n; i++){
+    int cmd = feature.geometry(i) & 0x7;
+    size_t count = feature.geometry(i) >> 3;
+    if(cmd == MoveTo || cmd == LineTo){
+      if(count > (n - i - 1) / 2)
+        throw std::runtime_error("Truncated geometry in vector tile feature");
+      for(size_t j = 0; j < count; j++){
+        pos[0] += zigzag32(feature.geometry(++i));
+        pos[1] += zigzag32(feature.geometry(++i));
+        if(out.empty() || (cmd == MoveTo && !points))
+          out.push_back(ring());
+        point p = {(double) pos[0], (double) pos[1]};
+        out.back().push_back(p);
+      }
+    } else if(cmd != ClosePath){
+      throw std::runtime_error("Invalid command in vector tile geometry");
+    }
+  }
+  return out;
+}
+
+class geobuf_encoder {
+public:
+  geobuf::Data *data;
+
+  geobuf_encoder(geobuf::Data *data, tile_position tile, double multiplier) :
+    data(data), tile(tile), multiplier(multiplier), extent(4096) {}
+
+  void feature(const vector_tile::Tile::Layer &layer, const vector_tile::Tile::Feature &x){
+    geobuf::Data::Feature out;
+    stats_items(1);
+    if(!geometry(x, layer.extent(), out.mutable_geometry()))
+      return;
+    // Ids above INT64_MAX do not fit the signed int_id of geobuf
+    if(x.has_id() && x.id() > (uint64_t) INT64_MAX)
+      out.set_id(std::to_string(x.id()));
+    else if(x.has_id())
+      out.set_int_id(x.id());
+    for(int i = 0; i + 1 < x.tags_size(); i += 2){
+      uint32_t key = x.tags(i);
+      uint32_t val = x.tags(i + 1);
+      if((int) key >= layer.keys_size() || (int) val >= layer.values_size())
+        throw std::runtime_error("Tag index out of bounds");
+      out.add_properties(key_index(layer.keys(key)));
+      out.add_properties(out.values_size());
+      value(layer.values(val), out.add_values());
+    }
+    data->mutable_feature_collection()->add_features()->Swap(&out);
+  }
+
+private:
+  tile_position tile;
+  double multiplier;
+  double extent;
+  int64_t cursor[2];
+  std::unordered_map<std::string, uint32_t> keys;
+
+  uint32_t key_index(const std::string &key){
+    std::unordered_map<std::string, uint32_t>::iterator it = keys.find(key);
+    if(it != keys.end())
+      return it->second;
+    uint32_t index = keys.size();
+    data->add_keys(key);
+    keys[key] = index;
+    return index;
+  }
+
+  static void signed_value(int64_t val, geobuf::Data::Value *out){
+    if(val < 0){
+      out->set_neg_int_value(-(uint64_t) val);
+    } else {
+      out->set_pos_int_value(val);
+    }
+  }
+
+  static void value(const vector_tile::Tile::Value &x, geobuf::Data::Value *out){
+    if(x.has_string_value()){
+      out->set_string_value(x.string_value());
+    } else if(x.has_double_value()){
+      out->set_double_value(x.double_value());
+    } else if(x.has_float_value()){
+      out->set_double_value(x.float_value());
+    } else if(x.has_int_value()){
+      signed_value(x.int_value(), out);
+    } else if(x.has_uint_value()){
+      out->set_pos_int_value(x.uint_value());
+    } else if(x.has_sint_value()){
+      signed_value(x.sint_value(), out);
+    } else if(x.has_bool_value()){
+      out->set_bool_value(x.bool_value());
+    } else {
+      throw std::runtime_error("Empty property value");
+    }
+  }
+
+  // Coordinates are limited to 2^62 such that the deltas also fit in int64
+  static int64_t quantize(double val){
+    if(!(std::fabs(val) < 4611686018427387904.0))
+      throw std::runtime_error("Coordinate out of range for the geobuf precision");
+    return (int64_t) round(val);
+  }
+
+  // Unprojects from tile coordinates to lon/lat, and quantizes to the precision
+  void coords(const ring &x, GeobufGeometry *out, bool delta){
+    if(!delta)
+      cursor[0] = cursor[1] = 0;
+    for(size_t i = 0; i < x.size(); i++){
+      double lon = ((tile.x + x[i].x / extent) / tile.n) * 360 - 180;
+      double lat = atan(sinh(M_PI - ((tile.y + x[i].y / extent) / tile.n) * 2 * M_PI)) * 180 / M_PI;
+      int64_t val[2] = {quantize(lon * multiplier), quantize(lat * multiplier)};
+      out->add_coords(val[0] - cursor[0]);
+      out->add_coords(val[1] - cursor[1]);
+      if(delta){
+        cursor[0] = val[0];
+        cursor[1] = val[1];
+      }
+    }
+  }
+
+  void line(const ring &x, GeobufGeometry *out){
+    cursor[0] = cursor[1] = 0;
+    coords(x, out, true);
+  }
+
+  bool geometry(const vector_tile::Tile::Feature &x, double layer_extent, GeobufGeometry *out){
+    extent = layer_extent;
+    std::vector<ring> rings = mvt_rings(x);
+    if(rings.empty())
+      return false;
+    switch(x.type()){
+    case vector_tile::Tile::POINT:
+      if(rings[0].size() == 1){
+        out->set_type(geobuf::Data_Geometry_Type_POINT);
+        coords(rings[0], out, false);
+      } else {
+        out->set_type(geobuf::Data_Geometry_Type_MULTIPOINT);
+        line(rings[0], out);
+      }
+      break;
+    case vector_tile::Tile::LINESTRING:
+      if(rings.size() == 1){
+        out->set_type(geobuf::Data_Geometry_Type_LINESTRING);
+        line(rings[0], out);
+      } else {
+        out->set_type(geobuf::Data_Geometry_Type_MULTILINESTRING);
+        for(size_t i = 0; i < rings.size(); i++){
+          out->add_lengths(rings[i].size());
+          line(rings[i], out);
+        }
+      }
+      break;
+    case vector_tile::Tile::POLYGON: {
+      // Each exterior ring (positive area) starts a new polygon
+      std::vector<std::vector<const ring*>> polygons;
+      for(size_t i = 0; i < rings.size(); i++){
+        if(polygons.empty() || ring_area(rings[i]) > 0)
+          polygons.push_back(std::vector<const ring*>());
+        polygons.back().push_back(&rings[i]);
+      }
+      if(polygons.size() == 1){
+        out->set_type(geobuf::Data_Geometry_Type_POLYGON);
+      } else {
+        out->set_type(geobuf::Data_Geometry_Type_MULTIPOLYGON);
+        out->add_lengths(polygons.size());
+      }
+      for(size_t i = 0; i < polygons.size(); i++){
+        if(polygons.size() > 1)
+          out->add_lengths(polygons[i].size());
+        for(size_t j = 0; j < polygons[i].size(); j++){
+          out->add_lengths(polygons[i][j]->size());
+          line(*polygons[i][j], out);
+        }
+      }
+      break;
+    }
+    default:
+      return false;
+    }
+    return true;
+  }
+};
+
+// [[Rcpp::export]]
+Rcpp::RawVector cpp_mvt2geobuf(Rcpp::RawVector x, Rcpp::NumericVector zxy, int precision, std::vector<std::string> layers){
+  stats_call stats("cpp_mvt2geobuf", x.size());
+  if(precision < 0 || precision > 15)
+    throw std::runtime_error("Precision must be between 0 and 15");
+  tile_position tile = make_tile(zxy);
+  vector_tile::Tile message;
+  {
+    stats_phase phase(PHASE_PARSE);
+    if(x.size() > INT_MAX || !message.ParseFromArray(x.begin(), x.size()))
+      throw std::runtime_error("Failed to parse mvt proto message");
+  }
+  stats_phase phase(PHASE_MATERIALIZE);
+  geobuf::Data data;
+  data.set_precision(precision);
+  data.set_dimensions(2);
+  data.mutable_feature_collection();
+  geobuf_encoder encoder(&data, tile, pow(10.0, precision));
+  for(int i = 0; i < message.layers_size(); i++){
+    const vector_tile::Tile::Layer &layer = message.layers(i);
+    if(layers.size() && std::find(layers.begin(), layers.end(), layer.name()) == layers.end())
+      continue;
+    for(int j = 0; j < layer.features_size(); j++)
+      encoder.feature(layer, layer.features(j));
+  }
+  stats_phase parse(PHASE_PARSE);
+#ifdef USENEWAPI
+  size_t size = data.ByteSizeLong();
+#else
+  size_t size = data.ByteSize();
+#endif
+  Rcpp::RawVector res(size);
+  stats_bytes(size);
+  stats_est_alloc(1);
+  if(!data.SerializeToArray(res.begin(), size))
+    throw std::runtime_error("Failed to serialize into geobuf message");
+  return res;
+}
@@ -1,4 +1,9 @@
 #include "geobuf.pb.h"
+#include "arrow.h"
+#include "kernel.h"
+#include "stats.h"
+#include "wire.h"
+#include "wkb.h"
 #include <Rcpp.h>
 
 //shothands
@@ -12,104 +17,311 @@ typedef Rcpp::NumericVector NumericVector;
 
 static uint32_t dim = 2;
 static double multiplier = 1000000;
+static double tolerance = 0;
+static bool as_wkb = false;
 static std::vector<std::string> keys;
 
-NumericVector build_one(Geometry x){
-  NumericVector out;
-  for (int i = 0; i < x.coords_size(); i++){
-    out.push_back(x.coords(i) / multiplier);
+// The coordinates of a generated Geometry or a geobuf_geometry_view
+template <typename G>
+const int64_t *coords_data(const G &x){
+  static_assert(sizeof(*x.coords().data()) == sizeof(int64_t), "coords must be 64 bit");
+  return reinterpret_cast<const int64_t*>(x.coords().data());
+}
+
+// Squared distance from point p to the segment a-b, in the first two dimensions
+static double segment_distance2(const double *p, const double *a, const double *b){
+  double x = a[0];
+  double y = a[1];
+  double dx = b[0] - x;
+  double dy = b[1] - y;
+  if(dx != 0 || dy != 0){
+    double t = ((p[0] - x) * dx + (p[1] - y) * dy) / (dx * dx + dy * dy);
+    if(t > 1){
+      x = b[0];
+      y = b[1];
+    } else if(t > 0){
+      x += dx * t;
+      y += dy * t;
+    }
   }
-  return out;
+  dx = p[0] - x;
+  dy = p[1] - y;
+  return dx * dx + dy * dy;
 }
 
-List build_two(Geometry x){
-  Rcpp::List coordinates;
-  std::vector<double> vec(dim);
-  for (size_t i = 0; i < x.coords_size() / dim; i++){
-    for (size_t j = 0; j < dim; j++){
-      vec[j] += x.coords(i * dim + j) / multiplier;
+// Douglas-Peucker simplification: returns the indices of the points to keep.
+// Index npoints of a closed ring refers to the first point. Rings always keep
+// at least 3 points, such that the polygon does not collapse.
+static std::vector<size_t> simplify_points(const double *vals, size_t npoints, bool closed){
+  std::vector<bool> keep(npoints + 1, false);
+  std::vector<std::pair<size_t, size_t>> spans;
+  auto point = [&](size_t i){ return vals + (i % npoints) * dim; };
+  auto farthest = [&](size_t first, size_t last, double *dist){
+    size_t index = first;
+    *dist = 0;
+    for(size_t i = first + 1; i < last; i++){
+      double d = segment_distance2(point(i), point(first), point(last));
+      if(d > *dist){
+        *dist = d;
+        index = i;
+      }
+    }
+    return index;
+  };
+  keep[0] = true;
+  if(closed){
+    if(npoints < 4)
+      return std::vector<size_t>();
+    // Start with the point farthest from the first point, and the point
+    // farthest from the line between these two
+    double d1, d2;
+    size_t k = farthest(0, npoints, &d1);
+    size_t a = farthest(0, k, &d1);
+    size_t b = farthest(k, npoints, &d2);
+    keep[k] = keep[npoints] = true;
+    keep[d1 >= d2 ? a : b] = true;
+    size_t first = 0;
+    for(size_t i = 1; i <= npoints; i++){
+      if(keep[i]){
+        spans.push_back(std::make_pair(first, i));
+        first = i;
+      }
     }
-    coordinates.push_back(NumericVector(Rcpp::wrap(vec)));
+  } else if(npoints > 2){
+    keep[npoints - 1] = true;
+    spans.push_back(std::make_pair((size_t) 0, npoints - 1));
+  } else {
+    return std::vector<size_t>();
+  }
+  double max_dist = tolerance * tolerance;
+  while(spans.size()){
+    std::pair<size_t, size_t> span = spans.back();
+    spans.pop_back();
+    double dist;
+    size_t index = farthest(span.first, span.second, &dist);
+    if(dist > max_dist){
+      keep[index] = true;
+      spans.push_back(std::make_pair(span.first, index));
+      spans.push_back(std::make_pair(index, span.second));
+    }
+  }
+  std::vector<size_t> out;
+  for(size_t i = 0; i < npoints; i++){
+    if(keep[i])
+      out.push_back(i);
+  }
+  return out;
+}
+
+// Decodes delta encoded points into 'vals' and returns the indices of the points
+// to keep. With a tolerance, this leaves out the points removed by simplification.
+static std::vector<size_t> decode_points(const int64_t *coords, size_t npoints, bool closed,
+                                         bool simplify, std::vector<double> &vals){
+  vals.resize(npoints * dim);
+  kernel_delta(coords, npoints, dim, multiplier, vals.data());
+  std::vector<size_t> index;
+  if(simplify && tolerance > 0 && dim >= 2)
+    index = simplify_points(vals.data(), npoints, closed);
+  if(index.empty()){
+    index.resize(npoints);
+    for(size_t i = 0; i < npoints; i++)
+      index[i] = i;
   }
+  return index;
+}
+
+// Decodes a line or ring of delta encoded points. Rings repeat the first point.
+List build_points(const int64_t *coords, size_t npoints, bool closed, bool simplify){
+  std::vector<double> vals;
+  std::vector<size_t> index = decode_points(coords, npoints, closed, simplify, vals);
+  size_t n = index.size();
+  bool close = closed && npoints > 0;
+  List out(n + close);
+  for (size_t i = 0; i < n; i++){
+    out[i] = NumericVector(vals.begin() + index[i] * dim, vals.begin() + (index[i] + 1) * dim);
+  }
+  if(close){
+    out[n] = NumericVector(vals.begin(), vals.begin() + dim);
+  }
+  return out;
+}
+
+template <typename G>
+NumericVector build_one(const G &x){
+  stats_est_alloc(1);
+  NumericVector out(x.coords_size());
+  for (int i = 0; i < x.coords_size(); i++){
+    out[i] = x.coords(i) / multiplier;
+  }
+  return out;
+}
 
+template <typename G>
+List build_two(const G &x){
+  stats_est_alloc(x.coords_size() / dim + 1);
   //Polygon must be closed
-  if(x.type() == geobuf::Data_Geometry_Type_POLYGON){
-    for (size_t j = 0; j < dim; j++){
-      //note: = instead of +=
-      vec[j] = x.coords(j) / multiplier;
-    }
-    coordinates.push_back(NumericVector(Rcpp::wrap(vec)));
+  bool closed = x.type() == geobuf::Data_Geometry_Type_POLYGON;
+  bool simplify = x.type() != geobuf::Data_Geometry_Type_MULTIPOINT;
+  return build_points(coords_data(x), x.coords_size() / dim, closed, simplify);
+}
+
+template <typename G>
+List build_three(const G &x){
+  stats_est_alloc(x.coords_size() / dim + x.lengths_size() + 1);
+  if(!x.lengths_size()){
+    return List::create(build_two(x));
+  }
+  bool closed = x.type() == geobuf::Data_Geometry_Type_POLYGON;
+  size_t groups = x.lengths_size();
+  size_t total = x.coords_size() / dim;
+  size_t offset = 0;
+  List out(groups);
+  for (size_t i = 0; i < groups; i++){
+    size_t groupsize = x.lengths(i);
+    if(groupsize > total - offset)
+      throw std::runtime_error("Geometry lengths exceed number of coordinates");
+    out[i] = build_points(coords_data(x) + offset * dim, groupsize, closed, true);
+    offset += groupsize;
   }
-  return coordinates;
+  return out;
 }
 
-List build_three(Geometry x){
-  List out;
+template <typename G>
+List build_four(const G &x){
+  stats_est_alloc(x.coords_size() / dim + x.lengths_size() + 1);
   if(!x.lengths_size()){
-    out.push_back(build_two(x));
-  } else {
-    size_t groups = x.lengths_size();
-    size_t offset = 0;
+    return List::create(build_two(x));
+  }
+  bool closed = x.type() == geobuf::Data_Geometry_Type_MULTIPOLYGON;
+  size_t total = x.coords_size() / dim;
+  int cursor = 0; //lengths position
+  size_t offset = 0; //coords position
+  auto next_length = [&](){
+    if(++cursor >= x.lengths_size())
+      throw std::runtime_error("Geometry lengths exceed number of coordinates");
+    return (size_t) x.lengths(cursor);
+  };
+  size_t sets = x.lengths(0);
+  List out(sets);
+  for(size_t s = 0; s < sets; s++){
+    size_t groups = next_length();
+    List coordinates(groups);
     for (size_t i = 0; i < groups; i++){
-      size_t groupsize = x.lengths(i);
-      Rcpp::List group;
-      std::vector<double> vec(dim);
-      for (size_t j = 0; j < groupsize; j++){
-        for (size_t k = 0; k < dim; k++){
-          vec[k] += x.coords((offset + j) * dim + k) / multiplier;
-        }
-        group.push_back(NumericVector(Rcpp::wrap(vec)));
-      }
-      //Polygon must be closed
-      if(x.type() == geobuf::Data_Geometry_Type_POLYGON){
-        for (size_t k = 0; k < dim; k++){
-          //note: = instead of +=
-          vec[k] = x.coords(offset * dim + k) / multiplier;
-        }
-        group.push_back(NumericVector(Rcpp::wrap(vec)));
-      }
+      size_t groupsize = next_length();
+      if(groupsize > total - offset)
+        throw std::runtime_error("Geometry lengths exceed number of coordinates");
+      coordinates[i] = build_points(coords_data(x) + offset * dim, groupsize, closed, true);
       offset += groupsize;
-      out.push_back(group);
     }
+    out[s] = coordinates;
   }
   return out;
 }
 
-List build_four(Geometry x){
-  List out;
-  if(!x.lengths_size()){
-    out.push_back(build_two(x));
-  } else {
-    int cursor = 0; //lengths position
-    int offset = 0; //coords position
-    int sets = x.lengths(0);
-    for(int s = 0; s < sets; s++){
-      List coordinates;
-      size_t groups = x.lengths(++cursor);
-      for (size_t i = 0; i < groups; i++){
-        R_xlen_t groupsize = x.lengths(++cursor);
-        Rcpp::List group;
-        std::vector<double> vec(dim);
-        for (R_xlen_t j = 0; j < groupsize; j++){
-          for (size_t k = 0; k < dim; k++){
-            vec[k] += x.coords((offset + j) * dim + k) / multiplier;
-          }
-          group.push_back(NumericVector(Rcpp::wrap(vec)));
-        }
-        //Polygon must be closed
-        if(x.type() == geobuf::Data_Geometry_Type_MULTIPOLYGON){
-          for (size_t k = 0; k < dim; k++){
-            vec[k] = x.coords(offset * dim + k) / multiplier;
-          }
-          group.push_back(NumericVector(Rcpp::wrap(vec)));
-        }
+// Writes the points of a WKB LineString or polygon ring, like build_points()
+static void wkb_points(wkb_writer &out, const int64_t *coords, size_t npoints, bool closed){
+  std::vector<double> vals;
+  std::vector<size_t> index = decode_points(coords, npoints, closed, true, vals);
+  bool close = closed && npoints > 0;
+  out.uint32(index.size() + close);
+  for(size_t i = 0; i < index.size(); i++)
+    out.point(vals.data() + index[i] * dim, dim);
+  if(close)
+    out.point(vals.data(), dim);
+}
+
+// Same structure as the lists from ungeo_geometry(), encoded as WKB
+template <typename G>
+void wkb_geometry(const G &x, wkb_writer &out){
+  size_t total = x.coords_size() / dim;
+  switch(x.type()){
+  case geobuf::Data_Geometry_Type_POINT:
+    out.geometry(WKB_POINT, dim);
+    for(size_t i = 0; i < dim; i++)
+      out.real((int) i < x.coords_size() ? x.coords(i) / multiplier : NAN);
+    break;
+  case geobuf::Data_Geometry_Type_MULTIPOINT: {
+    std::vector<double> vals(total * dim);
+    kernel_delta(coords_data(x), total, dim, multiplier, vals.data());
+    out.geometry(WKB_MULTIPOINT, dim);
+    out.uint32(total);
+    for(size_t i = 0; i < total; i++){
+      out.geometry(WKB_POINT, dim);
+      out.point(vals.data() + i * dim, dim);
+    }
+    break;
+  }
+  case geobuf::Data_Geometry_Type_LINESTRING:
+    out.geometry(WKB_LINESTRING, dim);
+    wkb_points(out, coords_data(x), total, false);
+    break;
+  case geobuf::Data_Geometry_Type_POLYGON:
+  case geobuf::Data_Geometry_Type_MULTILINESTRING: {
+    bool closed = x.type() == geobuf::Data_Geometry_Type_POLYGON;
+    out.geometry(closed ? WKB_POLYGON : WKB_MULTILINESTRING, dim);
+    size_t groups = x.lengths_size() ? x.lengths_size() : 1;
+    size_t offset = 0;
+    out.uint32(groups);
+    for(size_t i = 0; i < groups; i++){
+      size_t groupsize = x.lengths_size() ? x.lengths(i) : total;
+      if(groupsize > total - offset)
+        throw std::runtime_error("Geometry lengths exceed number of coordinates");
+      if(!closed)
+        out.geometry(WKB_LINESTRING, dim);
+      wkb_points(out, coords_data(x) + offset * dim, groupsize, closed);
+      offset += groupsize;
+    }
+    break;
+  }
+  case geobuf::Data_Geometry_Type_MULTIPOLYGON: {
+    out.geometry(WKB_MULTIPOLYGON, dim);
+    if(!x.lengths_size()){
+      out.uint32(1);
+      out.geometry(WKB_POLYGON, dim);
+      out.uint32(1);
+      wkb_points(out, coords_data(x), total, true);
+      break;
+    }
+    int cursor = 0;
+    size_t offset = 0;
+    auto next_length = [&](){
+      if(++cursor >= x.lengths_size())
+        throw std::runtime_error("Geometry lengths exceed number of coordinates");
+      return (size_t) x.lengths(cursor);
+    };
+    size_t sets = x.lengths(0);
+    out.uint32(sets);
+    for(size_t s = 0; s < sets; s++){
+      size_t groups = next_length();
+      out.geometry(WKB_POLYGON, dim);
+      out.uint32(groups);
+      for(size_t i = 0; i < groups; i++){
+        size_t groupsize = next_length();
+        if(groupsize > total - offset)
+          throw std::runtime_error("Geometry lengths exceed number of coordinates");
+        wkb_points(out, coords_data(x) + offset * dim, groupsize, true);
         offset += groupsize;
-        coordinates.push_back(group);
       }
-      out.push_back(coordinates);
     }
+    break;
   }
-  return out;
+  case geobuf::Data_Geometry_Type_GEOMETRYCOLLECTION:
+    out.geometry(WKB_GEOMETRYCOLLECTION, dim);
+    out.uint32(x.geometries_size());
+    for(int i = 0; i < x.geometries_size(); i++)
+      wkb_geometry(x.geometries(i), out);
+    break;
+  }
+}
+
+template <typename G>
+Rcpp::RawVector build_wkb(const G &x){
+  stats_est_alloc(1);
+  wkb_writer out;
+  wkb_geometry(x, out);
+  Rcpp::RawVector res(out.buf.size());
+  memcpy(res.begin(), out.buf.data(), out.buf.size());
+  return res;
 }
 
 std::string ungeo(Geometry::Type x){
@@ -125,7 +337,8 @@ std::string ungeo(Geometry::Type x){
   throw std::runtime_error("switch fall through");
 }
 
-List append_prop(List x, uint32_t key, Value val){
+template <typename V>
+List append_prop(List x, uint32_t key, const V &val){
   if(key > keys.size())
     throw std::runtime_error("Propety index out of bounds");
   std::string prop(keys.at(key));
@@ -150,6 +363,7 @@ List append_prop(List x, uint32_t key, Value val){
   } else if(val.has_bool_value()){
     x[prop] = (double) val.bool_value();
   } else if(val.has_json_value()){
+    stats_phase phase(PHASE_CALLBACK);
     Rcpp::Function parse_json = Rcpp::Environment::namespace_env("protolite")["parse_json"];
     x[prop] = parse_json(Rcpp::CharacterVector(val.json_value()));
   } else {
@@ -158,7 +372,8 @@ List append_prop(List x, uint32_t key, Value val){
   return x;
 }
 
-List ungeo(Geometry x){
+template <typename G>
+List ungeo_geometry(const G &x){
   List out;
   out["type"] = ungeo(x.type());
   for(int i = 0; i < x.custom_properties_size() / 2; i++){
@@ -167,7 +382,7 @@ List ungeo(Geometry x){
   if(x.geometries_size()){
     List geometries;
     for(int i = 0; i < x.geometries_size(); i++){
-      geometries.push_back(ungeo(x.geometries(i)));
+      geometries.push_back(ungeo_geometry(x.geometries(i)));
     }
     out["geometries"] = geometries;
   }
@@ -185,11 +400,16 @@ List ungeo(Geometry x){
   return out;
 }
 
-List ungeo(Feature x){
+template <typename F>
+List ungeo_feature(const F &x){
   List out;
+  stats_items(1);
   out["type"] = "Feature";
-  if(x.has_geometry())
-    out["geometry"] = ungeo(x.geometry());
+  if(x.has_geometry() && as_wkb){
+    out["geometry"] = build_wkb(x.geometry());
+  } else if(x.has_geometry()){
+    out["geometry"] = ungeo_geometry(x.geometry());
+  }
   if(x.has_id()){
     out["id"] = x.id();
   } else if(x.has_int_id()){
@@ -208,12 +428,13 @@ List ungeo(Feature x){
   return out;
 }
 
-List ungeo(FeatureCollection x){
+template <typename C>
+List ungeo_collection(const C &x){
   List out;
   List features;
 
   for(int i = 0; i < x.features_size(); i++){
-    features.push_back(ungeo(x.features(i)));
+    features.push_back(ungeo_feature(x.features(i)));
   }
   out["type"] = "FeatureCollection";
   out["features"] = features;
@@ -224,23 +445,32 @@ List ungeo(FeatureCollection x){
 }
 
 // [[Rcpp::export]]
-List cpp_unserialize_geobuf(Rcpp::RawVector x){
+Rcpp::RObject cpp_unserialize_geobuf(Rcpp::RawVector x, double tol = 0, bool wkb = false){
+  stats_call stats("cpp_unserialize_geobuf", x.size());
   geobuf::Data message;
-  if(!message.ParseFromArray(x.begin(), x.size()))
-    throw std::runtime_error("Failed to parse geobuf proto message");
+  {
+    stats_phase phase(PHASE_PARSE);
+    if(!message.ParseFromArray(x.begin(), x.size()))
+      throw std::runtime_error("Failed to parse geobuf proto message");
+  }
+  stats_phase phase(PHASE_MATERIALIZE);
   dim = message.dimensions();
   multiplier = pow(10.0, message.precision());
+  tolerance = tol;
+  as_wkb = wkb;
   keys.clear();
   for(int i = 0; i < message.keys_size(); i++){
     keys.push_back(message.keys(i));
   }
-  List out;
+  Rcpp::RObject out;
   if(message.has_feature_collection()){
-    out = ungeo(message.feature_collection());
+    out = ungeo_collection(message.feature_collection());
   } else if(message.has_feature()){
-    out = ungeo(message.feature());
+    out = ungeo_feature(message.feature());
+  } else if(message.has_geometry() && as_wkb){
+    out = build_wkb(message.geometry());
   } else if(message.has_geometry()){
-    out = ungeo(message.geometry());
+    out = ungeo_geometry(message.geometry());
   } else {
     throw std::runtime_error("No 'data_type' field set");
   }
@@ -248,3 +478,393 @@ List cpp_unserialize_geobuf(Rcpp::RawVector x){
   return out;
 }
 
+
+/* Views on the wire encoding of the geobuf messages, used by the decoder for
+ * options(protolite.decoder = "wire"). They implement the accessors of the
+ * generated classes that are used by the templates above, so both decoders
+ * share the same code. Each view scans its own message once, and submessages
+ * are only scanned when they are accessed. */
+
+class geobuf_value_view {
+public:
+  geobuf_value_view(wire_span msg) : string_(), json_(), has_(0), double_(0), pos_int_(0), neg_int_(0), bool_(false) {
+    wire_reader in(msg);
+    while(in.next()){
+      switch(in.field){
+      case Value::kStringValueFieldNumber:
+        in.expect(WIRE_LENGTH);
+        string_ = in.bytes();
+        break;
+      case Value::kDoubleValueFieldNumber:
+        in.expect(WIRE_FIXED64);
+        double_ = in.real();
+        break;
+      case Value::kPosIntValueFieldNumber:
+        in.expect(WIRE_VARINT);
+        pos_int_ = in.varint();
+        break;
+      case Value::kNegIntValueFieldNumber:
+        in.expect(WIRE_VARINT);
+        neg_int_ = in.varint();
+        break;
+      case Value::kBoolValueFieldNumber:
+        in.expect(WIRE_VARINT);
+        bool_ = in.varint() != 0;
+        break;
+      case Value::kJsonValueFieldNumber:
+        in.expect(WIRE_LENGTH);
+        json_ = in.bytes();
+        break;
+      default:
+        in.skip();
+        continue;
+      }
+      has_ |= 1 << in.field;
+    }
+  }
+  bool has_string_value() const { return has(Value::kStringValueFieldNumber); }
+  bool has_double_value() const { return has(Value::kDoubleValueFieldNumber); }
+  bool has_pos_int_value() const { return has(Value::kPosIntValueFieldNumber); }
+  bool has_neg_int_value() const { return has(Value::kNegIntValueFieldNumber); }
+  bool has_bool_value() const { return has(Value::kBoolValueFieldNumber); }
+  bool has_json_value() const { return has(Value::kJsonValueFieldNumber); }
+  std::string string_value() const { return std::string((const char*) string_.data, string_.size); }
+  double double_value() const { return double_; }
+  uint64_t pos_int_value() const { return pos_int_; }
+  uint64_t neg_int_value() const { return neg_int_; }
+  bool bool_value() const { return bool_; }
+  std::string json_value() const { return std::string((const char*) json_.data, json_.size); }
+private:
+  bool has(int field) const { return has_ & (1 << field); }
+  wire_span string_;
+  wire_span json_;
+  uint32_t has_;
+  double double_;
+  uint64_t pos_int_;
+  uint64_t neg_int_;
+  bool bool_;
+};
+
+// Fields that are shared by Geometry, Feature and FeatureCollection
+class geobuf_props_view {
+public:
+  int custom_properties_size() const { return custom_properties_.size(); }
+  uint32_t custom_properties(int i) const { return custom_properties_.at(i); }
+  geobuf_value_view values(int i) const { return geobuf_value_view(values_.at(i)); }
+protected:
+  bool scan_props(wire_reader &in){
+    if(in.field == Geometry::kValuesFieldNumber){
+      in.expect(WIRE_LENGTH);
+      values_.push_back(in.bytes());
+    } else if(in.field == Geometry::kCustomPropertiesFieldNumber){
+      in.varints([&](uint64_t val){ custom_properties_.push_back(val); });
+    } else {
+      return false;
+    }
+    return true;
+  }
+  std::vector<uint32_t> custom_properties_;
+  std::vector<wire_span> values_;
+};
+
+class geobuf_geometry_view : public geobuf_props_view {
+public:
+  geobuf_geometry_view(wire_span msg) : type_(geobuf::Data_Geometry_Type_POINT) {
+    bool has_type = false;
+    wire_reader in(msg);
+    while(in.next()){
+      switch(in.field){
+      case Geometry::kTypeFieldNumber: {
+        in.expect(WIRE_VARINT);
+        int val = (int) in.varint();
+        if(Geometry::Type_IsValid(val)){
+          type_ = (Geometry::Type) val;
+          has_type = true;
+        }
+        break;
+      }
+      case Geometry::kLengthsFieldNumber:
+        in.varints([&](uint64_t val){ lengths_.push_back(val); });
+        break;
+      case Geometry::kCoordsFieldNumber:
+        kernel_packed_sint64(in, coords_);
+        break;
+      case Geometry::kGeometriesFieldNumber:
+        in.expect(WIRE_LENGTH);
+        geometries_.push_back(in.bytes());
+        break;
+      default:
+        if(!scan_props(in))
+          in.skip();
+      }
+    }
+    // type is a required field
+    if(!has_type)
+      throw std::runtime_error("Failed to parse geobuf proto message");
+  }
+  Geometry::Type type() const { return type_; }
+  int lengths_size() const { return lengths_.size(); }
+  uint32_t lengths(int i) const { return lengths_.at(i); }
+  int coords_size() const { return coords_.size(); }
+  int64_t coords(int i) const { return coords_.at(i); }
+  const std::vector<int64_t> &coords() const { return coords_; }
+  int geometries_size() const { return geometries_.size(); }
+  geobuf_geometry_view geometries(int i) const { return geobuf_geometry_view(geometries_.at(i)); }
+private:
+  Geometry::Type type_;
+  std::vector<uint32_t> lengths_;
+  std::vector<int64_t> coords_;
+  std::vector<wire_span> geometries_;
+};
+
+class geobuf_feature_view : public geobuf_props_view {
+public:
+  geobuf_feature_view(wire_span msg) : geometry_(), id_(), has_geometry_(false), has_id_(false), has_int_id_(false), int_id_(0) {
+    wire_reader in(msg);
+    while(in.next()){
+      switch(in.field){
+      case Feature::kGeometryFieldNumber:
+        in.expect(WIRE_LENGTH);
+        geometry_ = in.bytes();
+        has_geometry_ = true;
+        break;
+      case Feature::kIdFieldNumber:
+        in.expect(WIRE_LENGTH);
+        id_ = in.bytes();
+        has_id_ = true;
+        break;
+      case Feature::kIntIdFieldNumber:
+        in.expect(WIRE_VARINT);
+        int_id_ = zigzag64(in.varint());
+        has_int_id_ = true;
+        break;
+      case Feature::kPropertiesFieldNumber:
+        in.varints([&](uint64_t val){ properties_.push_back(val); });
+        break;
+      default:
+        if(!scan_props(in))
+          in.skip();
+      }
+    }
+    // geometry is a required field
+    if(!has_geometry_)
+      throw std::runtime_error("Failed to parse geobuf proto message");
+  }
+  bool has_geometry() const { return has_geometry_; }
+  geobuf_geometry_view geometry() const { return geobuf_geometry_view(geometry_); }
+  bool has_id() const { return has_id_; }
+  std::string id() const { return std::string((const char*) id_.data, id_.size); }
+  bool has_int_id() const { return has_int_id_; }
+  int64_t int_id() const { return int_id_; }
+  int properties_size() const { return properties_.size(); }
+  uint32_t properties(int i) const { return properties_.at(i); }
+private:
+  wire_span geometry_;
+  wire_span id_;
+  bool has_geometry_;
+  bool has_id_;
+  bool has_int_id_;
+  int64_t int_id_;
+  std::vector<uint32_t> properties_;
+};
+
+class geobuf_collection_view : public geobuf_props_view {
+public:
+  geobuf_collection_view(wire_span msg){
+    wire_reader in(msg);
+    while(in.next()){
+      if(in.field == FeatureCollection::kFeaturesFieldNumber){
+        in.expect(WIRE_LENGTH);
+        features_.push_back(in.bytes());
+      } else if(!scan_props(in)){
+        in.skip();
+      }
+    }
+  }
+  int features_size() const { return features_.size(); }
+  geobuf_feature_view features(int i) const { return geobuf_feature_view(features_.at(i)); }
+
+  // Keep only the given features (1-based). The features are not decoded
+  // until they are accessed, so this only costs a lookup in the offset table.
+  void select(Rcpp::IntegerVector index){
+    std::vector<wire_span> selected(index.size());
+    for(R_xlen_t i = 0; i < index.size(); i++){
+      if(index[i] < 1 || (size_t) index[i] > features_.size())
+        throw std::runtime_error("Feature index out of bounds");
+      selected[i] = features_[index[i] - 1];
+    }
+    features_.swap(selected);
+  }
+private:
+  std::vector<wire_span> features_;
+};
+
+// The top level message. This also sets the global keys, dim and multiplier.
+class geobuf_data_view {
+public:
+  uint32_t precision;
+  wire_span data[3];
+  bool has_data[3];
+
+  geobuf_data_view(const Rbyte *buf, size_t len) : precision(6), data(), has_data() {
+    uint32_t dimensions = 2;
+    keys.clear();
+    wire_reader in(buf, len);
+    while(in.next()){
+      switch(in.field){
+      case Data::kKeysFieldNumber:
+        in.expect(WIRE_LENGTH);
+        keys.push_back(in.string());
+        break;
+      case Data::kDimensionsFieldNumber:
+        in.expect(WIRE_VARINT);
+        dimensions = in.varint();
+        break;
+      case Data::kPrecisionFieldNumber:
+        in.expect(WIRE_VARINT);
+        precision = in.varint();
+        break;
+      case Data::kFeatureCollectionFieldNumber:
+      case Data::kFeatureFieldNumber:
+      case Data::kGeometryFieldNumber:
+        in.expect(WIRE_LENGTH);
+        data[in.field - Data::kFeatureCollectionFieldNumber] = in.bytes();
+        has_data[in.field - Data::kFeatureCollectionFieldNumber] = true;
+        break;
+      default:
+        in.skip();
+      }
+    }
+    dim = dimensions;
+    multiplier = pow(10.0, precision);
+  }
+};
+
+// [[Rcpp::export]]
+Rcpp::RObject cpp_unserialize_geobuf_wire(Rcpp::RawVector x, double tol = 0, bool wkb = false){
+  stats_call stats("cpp_unserialize_geobuf_wire", x.size());
+  stats_phase phase(PHASE_MATERIALIZE);
+  geobuf_data_view data(x.begin(), x.size());
+  tolerance = tol;
+  as_wkb = wkb;
+  Rcpp::RObject out;
+  if(data.has_data[0]){
+    out = ungeo_collection(geobuf_collection_view(data.data[0]));
+  } else if(data.has_data[1]){
+    out = ungeo_feature(geobuf_feature_view(data.data[1]));
+  } else if(data.has_data[2] && as_wkb){
+    out = build_wkb(geobuf_geometry_view(data.data[2]));
+  } else if(data.has_data[2]){
+    out = ungeo_geometry(geobuf_geometry_view(data.data[2]));
+  } else {
+    throw std::runtime_error("No 'data_type' field set");
+  }
+  out.attr("precision") = data.precision;
+  return out;
+}
+
+// [[Rcpp::export]]
+List cpp_unserialize_geobuf_features(Rcpp::RawVector x, Rcpp::IntegerVector features, double tol = 0, bool wkb = false){
+  stats_call stats("cpp_unserialize_geobuf_features", x.size());
+  stats_phase phase(PHASE_MATERIALIZE);
+  geobuf_data_view data(x.begin(), x.size());
+  tolerance = tol;
+  as_wkb = wkb;
+  if(!data.has_data[0])
+    throw std::runtime_error("Selecting features requires a FeatureCollection");
+  geobuf_collection_view collection(data.data[0]);
+  collection.select(features);
+  List out = ungeo_collection(collection);
+  out.attr("precision") = data.precision;
+  return out;
+}
+
+template <typename V>
+static arrow_value geobuf_arrow_value(const V &val){
+  arrow_value out = {0, false, 0, 0, ""};
+  if(val.has_string_value()){
+    out.kind = ARROW_STRING;
+    out.s = val.string_value();
+  } else if(val.has_double_value()){
+    out.kind = ARROW_DOUBLE;
+    out.d = val.double_value();
+  } else if(val.has_pos_int_value()){
+    uint64_t num = val.pos_int_value();
+    out.kind = num > INT64_MAX ? ARROW_DOUBLE : ARROW_INT;
+    out.i = num;
+    out.d = num;
+  } else if(val.has_neg_int_value()){
+    uint64_t num = val.neg_int_value();
+    out.kind = num > INT64_MAX ? ARROW_DOUBLE : ARROW_INT;
+    out.i = -(int64_t) num;
+    out.d = -(double) num;
+  } else if(val.has_bool_value()){
+    out.kind = ARROW_BOOL;
+    out.b = val.bool_value();
+  } else if(val.has_json_value()){
+    out.kind = ARROW_STRING;
+    out.s = val.json_value();
+  }
+  return out;
+}
+
+// Exports the features as a record batch with the id (if any), the geometry as
+// WKB (geoarrow.wkb) and a typed column for each key. Json values are strings.
+static void geobuf_arrow(const geobuf_collection_view &collection, ArrowSchema *schema, ArrowArray *array){
+  int n = collection.features_size();
+  std::vector<geobuf_feature_view> features;
+  bool has_id = false;
+  bool has_int_id = false;
+  for(int i = 0; i < n; i++){
+    features.push_back(collection.features(i));
+    has_id = has_id || features.back().has_id();
+    has_int_id = has_int_id || features.back().has_int_id();
+  }
+  arrow_column geometry("geometry", "z", arrow_metadata({
+    {"ARROW:extension:name", "geoarrow.wkb"},
+    {"ARROW:extension:metadata", "{\"crs\":\"OGC:CRS84\"}"}
+  }));
+  arrow_column id("id", has_id ? "u" : "l");
+  std::vector<arrow_row> rows(n);
+  for(int i = 0; i < n; i++){
+    const geobuf_feature_view &feature = features[i];
+    stats_items(1);
+    if(feature.has_id()){
+      std::string val = feature.id();
+      id.append_bytes(val.data(), val.size());
+    } else if(feature.has_int_id() && has_id){
+      std::string val = std::to_string(feature.int_id());
+      id.append_bytes(val.data(), val.size());
+    } else if(feature.has_int_id()){
+      id.append_int64(feature.int_id());
+    } else {
+      id.append_null();
+    }
+    if(feature.has_geometry()){
+      wkb_writer wkb;
+      wkb_geometry(feature.geometry(), wkb);
+      geometry.append_bytes(wkb.buf.data(), wkb.buf.size());
+    } else {
+      geometry.append_null();
+    }
+    for(int j = 0; j < feature.properties_size() / 2; j++)
+      rows[i].push_back(std::make_pair(feature.properties(j * 2), geobuf_arrow_value(feature.values(j))));
+  }
+  std::vector<arrow_column> columns;
+  if(has_id || has_int_id)
+    columns.push_back(id);
+  columns.push_back(geometry);
+  arrow_properties(columns, keys, rows);
+  arrow_export(columns, n, schema, array);
+}
+
+// [[Rcpp::export]]
+void cpp_geobuf_arrow(Rcpp::RawVector x, SEXP schema, SEXP array){
+  stats_call stats("cpp_geobuf_arrow", x.size());
+  stats_phase phase(PHASE_MATERIALIZE);
+  geobuf_data_view data(x.begin(), x.size());
+  tolerance = 0;
+  if(!data.has_data[0])
+    throw std::runtime_error("Arrow export requires a FeatureCollection");
+  geobuf_arrow(geobuf_collection_view(data.data[0]), arrow_schema_xptr(schema), arrow_array_xptr(array));
+}
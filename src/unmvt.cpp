@@ -1,4 +1,9 @@
 #include "mvt.pb.h"
+#include "arrow.h"
+#include "kernel.h"
+#include "stats.h"
+#include "wire.h"
+#include "wkb.h"
 #include <Rcpp.h>
 
 //shothands
@@ -27,52 +32,191 @@ static std::string type2string(Tile::GeomType x){
   throw std::runtime_error("switch fall through");
 }
 
-static Rcpp::NumericMatrix decode_geometry(std::vector<int> geom, double extent){
-  int x = 0;
-  int y = 0;
+// Number of vertices in the geometry, counting ClosePath as a vertex
+static size_t count_vertices(const uint32_t *geom, size_t n){
+  size_t len = 0;
+  for(size_t i = 0; i < n; i++){
+    int cmd = cmd_command(geom[i]);
+    size_t count = cmd_count(geom[i]);
+    if(cmd == LineTo || cmd == MoveTo){
+      if(count > (n - i - 1) / 2)
+        throw std::runtime_error("Truncated geometry in vector tile feature");
+      len += count;
+      i += 2 * count;
+    } else if(cmd == ClosePath){
+      len++;
+    }
+  }
+  return len;
+}
+
+// Decodes the vertices into x and y (divided by the extent) and the group of
+// each vertex. Each point of a MoveTo starts a new group.
+static void decode_vertices(const uint32_t *geom, size_t n, double extent, double *xvec, double *yvec, double *gvec){
+  int64_t pos[2] = {0, 0};
+  int64_t start[2] = {0, 0};
+  size_t row = 0;
   int g = 0;
-  int x0 = 0;
-  int y0 = 0;
-  std::vector<double> xvec;
-  std::vector<double> yvec;
-  std::vector<int> gvec;
-  for(size_t i = 0; i < geom.size(); i++){
-    int cmd = cmd_command(geom.at(i));
-    int count = cmd_count(geom.at(i));
+  for(size_t i = 0; i < n; i++){
+    int cmd = cmd_command(geom[i]);
+    size_t count = cmd_count(geom[i]);
     //REprintf("Command: %d with count %d\n", cmd, count);
     if(cmd == LineTo || cmd == MoveTo){
-      for(int j = 0; j < count; j++){
-        int px = geom.at(++i);
-        int py = geom.at(++i);
-        x += ((px >> 1) ^ (-(px & 1)));
-        y += ((py >> 1) ^ (-(py & 1)));
-        xvec.push_back(x / extent);
-        yvec.push_back(y / extent);
-        if(cmd == MoveTo){
+      kernel_delta_zigzag32(geom + i + 1, count, pos, extent, xvec + row, yvec + row);
+      for(size_t j = 0; j < count; j++){
+        //each point of a MoveTo starts a new group
+        if(cmd == MoveTo)
           g++;
-          x0 = x;
-          y0 = y;
-        }
-        gvec.push_back(g);
+        gvec[row++] = g;
       }
+      if(cmd == MoveTo && count > 0){
+        start[0] = pos[0];
+        start[1] = pos[1];
+      }
+      i += 2 * count;
     } else if(cmd == ClosePath){
-      xvec.push_back(x0/ extent);
-      yvec.push_back(y0/ extent);
-      gvec.push_back(g);
+      xvec[row] = start[0] / extent;
+      yvec[row] = start[1] / extent;
+      gvec[row++] = g;
     }
   }
-  int len = xvec.size();
+}
+
+static Rcpp::NumericMatrix decode_geometry(const uint32_t *geom, size_t n, double extent){
+  // Count the vertices to allocate the matrix at once
+  size_t len = count_vertices(geom, n);
+  stats_est_alloc(1);
   Rcpp::NumericMatrix mat(len, 3);
-  for(int i = 0; i < len; i++){
-    mat.at(i, 0) = xvec.at(i);
-    mat.at(i, 1) = yvec.at(i);
-    mat.at(i, 2) = gvec.at(i);
-  }
+  double *xvec = mat.begin();
+  decode_vertices(geom, n, extent, xvec, xvec + len, xvec + 2 * len);
   return mat;
 }
 
-List unmapbox(Feature feature, Rcpp::CharacterVector all_keys, Rcpp::List all_values, double extent){
+// Position of the tile, to project vertices like mvt_decode_tile() in R does
+struct mvt_projection {
+  double z;
+  double x;
+  double y;
+  bool latlon;
+};
+
+#define MAXEXTENT 20037508.342789244
+
+// Writes the points from..to as WKB coordinates, projected from the tile
+static void wkb_vertices(wkb_writer &out, const mvt_projection *proj, const double *xvec,
+                         const double *yvec, size_t from, size_t to){
+  double n = pow(2, proj->z);
+  for(size_t i = from; i < to; i++){
+    double x = (proj->x + xvec[i]) / n;
+    double y = (proj->y + yvec[i]) / n;
+    if(proj->latlon){
+      out.real(x * 360 - 180);
+      out.real(atan(sinh(M_PI - y * 2 * M_PI)) * (180 / M_PI));
+    } else {
+      out.real(x * (2 * MAXEXTENT) - MAXEXTENT);
+      out.real(-1 * (y * (2 * MAXEXTENT) - MAXEXTENT));
+    }
+  }
+}
+
+// Area of a ring in tile coordinates (surveyor's formula). Exterior rings are
+// positive and holes negative, see the vector tile spec.
+static double ring_area(const double *xvec, const double *yvec, size_t from, size_t to){
+  double area = 0;
+  for(size_t i = from; i < to; i++){
+    size_t j = i + 1 < to ? i + 1 : from;
+    area += xvec[i] * yvec[j] - xvec[j] * yvec[i];
+  }
+  return area / 2;
+}
+
+// Same geometries as read_mvt_sf(), encoded as WKB
+static void write_wkb(wkb_writer &out, const uint32_t *geom, size_t n, GeomType type, double extent, const mvt_projection *proj){
+  size_t len = count_vertices(geom, n);
+  std::vector<double> vals(3 * len);
+  double *xvec = vals.data();
+  double *yvec = xvec + len;
+  double *gvec = yvec + len;
+  decode_vertices(geom, n, extent, xvec, yvec, gvec);
+
+  // Start and end of each group of vertices
+  std::vector<size_t> groups;
+  for(size_t i = 0; i < len; i++){
+    if(i == 0 || gvec[i] != gvec[i - 1])
+      groups.push_back(i);
+  }
+  groups.push_back(len);
+  size_t ngroups = groups.size() - 1;
+  switch(type){
+  case Tile::POINT:
+    if(len == 1){
+      out.geometry(WKB_POINT, 2);
+      wkb_vertices(out, proj, xvec, yvec, 0, 1);
+    } else {
+      out.geometry(WKB_MULTIPOINT, 2);
+      out.uint32(len);
+      for(size_t i = 0; i < len; i++){
+        out.geometry(WKB_POINT, 2);
+        wkb_vertices(out, proj, xvec, yvec, i, i + 1);
+      }
+    }
+    break;
+  case Tile::LINESTRING:
+    if(ngroups != 1){
+      out.geometry(WKB_MULTILINESTRING, 2);
+      out.uint32(ngroups);
+    }
+    for(size_t i = 0; i < ngroups; i++){
+      out.geometry(WKB_LINESTRING, 2);
+      out.uint32(groups[i + 1] - groups[i]);
+      wkb_vertices(out, proj, xvec, yvec, groups[i], groups[i + 1]);
+    }
+    break;
+  case Tile::POLYGON: {
+    // Each exterior ring starts a new polygon, followed by its holes
+    std::vector<size_t> polygons;
+    for(size_t i = 0; i < ngroups; i++){
+      if(i == 0 || ring_area(xvec, yvec, groups[i], groups[i + 1]) > 0)
+        polygons.push_back(i);
+    }
+    polygons.push_back(ngroups);
+    size_t npolygons = polygons.size() - 1;
+    if(npolygons != 1){
+      out.geometry(WKB_MULTIPOLYGON, 2);
+      out.uint32(npolygons);
+    }
+    for(size_t p = 0; p < npolygons; p++){
+      out.geometry(WKB_POLYGON, 2);
+      out.uint32(polygons[p + 1] - polygons[p]);
+      for(size_t i = polygons[p]; i < polygons[p + 1]; i++){
+        out.uint32(groups[i + 1] - groups[i]);
+        wkb_vertices(out, proj, xvec, yvec, groups[i], groups[i + 1]);
+      }
+    }
+    break;
+  }
+  case Tile::UNKNOWN:
+    out.geometry(WKB_GEOMETRYCOLLECTION, 2);
+    out.uint32(0);
+    break;
+  }
+}
+
+static Rcpp::RawVector decode_wkb(const uint32_t *geom, size_t n, GeomType type, double extent, const mvt_projection *proj){
+  wkb_writer out;
+  write_wkb(out, geom, n, type, extent, proj);
+  stats_est_alloc(1);
+  Rcpp::RawVector res(out.buf.size());
+  memcpy(res.begin(), out.buf.data(), out.buf.size());
+  return res;
+}
+
+template <typename F>
+List unmapbox(const F &feature, Rcpp::CharacterVector all_keys, Rcpp::List all_values, double extent,
+              const mvt_projection *proj){
   List out;
+  stats_items(1);
+  stats_est_alloc(4);
   out["id"] = feature.id();
   out["type"] = type2string(feature.type());
   int n_attrib = feature.tags_size() / 2;
@@ -87,16 +231,16 @@ List unmapbox(Feature feature, Rcpp::CharacterVector all_keys, Rcpp::List all_va
   attributes.attr("names") = names;
   out["attributes"] = attributes;
 
-  int n_geometry = feature.geometry_size();
-  std::vector<int> geometry(n_geometry);
-  for(int i = 0; i < n_geometry; i++){
-    geometry[i] = feature.geometry(i);
+  if(proj){
+    out["geometry"] = decode_wkb(feature.geometry().data(), feature.geometry_size(), feature.type(), extent, proj);
+  } else {
+    out["geometry"] = decode_geometry(feature.geometry().data(), feature.geometry_size(), extent);
   }
-  out["geometry"] = decode_geometry(geometry, extent);
   return out;
 }
 
-List unmapbox(Layer layer){
+template <typename L>
+List unmapbox(const L &layer, const mvt_projection *proj = NULL){
   List out;
   out["version"] = layer.version();
   out["name"] = layer.name();
@@ -114,7 +258,7 @@ List unmapbox(Layer layer){
   int n_values = layer.values_size();
   Rcpp::List values(n_values);
   for(int i = 0; i < n_values; i++){
-    Value val = layer.values(i);
+    const auto &val = layer.values(i);
     if(val.has_bool_value()){
       values.at(i) = val.bool_value();
     } else if(val.has_double_value()){
@@ -136,21 +280,381 @@ List unmapbox(Layer layer){
   int n_features = layer.features_size();
   Rcpp::List features(n_features);
   for(int i = 0; i < n_features; i++){
-    features.at(i) = unmapbox(layer.features(i), keys, values, layer.extent());
+    features.at(i) = unmapbox(layer.features(i), keys, values, layer.extent(), proj);
   }
   out["features"] = features;
   return out;
 }
 
-// [[Rcpp::export]]
-Rcpp::List cpp_unserialize_mvt(Rcpp::RawVector x){
+static Rcpp::List decode_tile(Rcpp::RawVector x, const mvt_projection *proj){
   vector_tile::Tile message;
-  if(!message.ParseFromArray(x.begin(), x.size()))
-    throw std::runtime_error("Failed to parse geobuf proto message");
+  {
+    stats_phase phase(PHASE_PARSE);
+    if(!message.ParseFromArray(x.begin(), x.size()))
+      throw std::runtime_error("Failed to parse mvt proto message");
+  }
+  stats_phase phase(PHASE_MATERIALIZE);
   int n = message.layers_size();
   Rcpp::List out(n);
   for(int i = 0; i < n; i++){
-    out[i] = unmapbox(message.layers(i));
+    out[i] = unmapbox(message.layers(i), proj);
+  }
+  return out;
+}
+
+// [[Rcpp::export]]
+Rcpp::List cpp_unserialize_mvt(Rcpp::RawVector x){
+  stats_call stats("cpp_unserialize_mvt", x.size());
+  return decode_tile(x, NULL);
+}
+
+/* Views on the wire encoding of the Layer, Feature and Value messages, used by
+ * the decoder for options(protolite.decoder = "wire"). They implement the
+ * accessors of the generated classes that are used by unmapbox() above, so both
+ * decoders share the same code, without creating a message per feature or value. */
+
+class mvt_value_view {
+public:
+  mvt_value_view(wire_span msg) : string_(), has_(0), float_(0), double_(0), int_(0), uint_(0), sint_(0), bool_(false) {
+    wire_reader in(msg);
+    while(in.next()){
+      switch(in.field){
+      case Value::kStringValueFieldNumber:
+        in.expect(WIRE_LENGTH);
+        string_ = in.bytes();
+        break;
+      case Value::kFloatValueFieldNumber: {
+        in.expect(WIRE_FIXED32);
+        uint32_t bits = in.fixed32();
+        memcpy(&float_, &bits, 4);
+        break;
+      }
+      case Value::kDoubleValueFieldNumber:
+        in.expect(WIRE_FIXED64);
+        double_ = in.real();
+        break;
+      case Value::kIntValueFieldNumber:
+        in.expect(WIRE_VARINT);
+        int_ = in.varint();
+        break;
+      case Value::kUintValueFieldNumber:
+        in.expect(WIRE_VARINT);
+        uint_ = in.varint();
+        break;
+      case Value::kSintValueFieldNumber:
+        in.expect(WIRE_VARINT);
+        sint_ = zigzag64(in.varint());
+        break;
+      case Value::kBoolValueFieldNumber:
+        in.expect(WIRE_VARINT);
+        bool_ = in.varint() != 0;
+        break;
+      default:
+        in.skip();
+        continue;
+      }
+      has_ |= 1 << in.field;
+    }
+  }
+  bool has_string_value() const { return has(Value::kStringValueFieldNumber); }
+  bool has_float_value() const { return has(Value::kFloatValueFieldNumber); }
+  bool has_double_value() const { return has(Value::kDoubleValueFieldNumber); }
+  bool has_int_value() const { return has(Value::kIntValueFieldNumber); }
+  bool has_uint_value() const { return has(Value::kUintValueFieldNumber); }
+  bool has_sint_value() const { return has(Value::kSintValueFieldNumber); }
+  bool has_bool_value() const { return has(Value::kBoolValueFieldNumber); }
+  std::string string_value() const { return std::string((const char*) string_.data, string_.size); }
+  float float_value() const { return float_; }
+  double double_value() const { return double_; }
+  int64_t int_value() const { return int_; }
+  uint64_t uint_value() const { return uint_; }
+  int64_t sint_value() const { return sint_; }
+  bool bool_value() const { return bool_; }
+private:
+  bool has(int field) const { return has_ & (1 << field); }
+  wire_span string_;
+  uint32_t has_;
+  float float_;
+  double double_;
+  int64_t int_;
+  uint64_t uint_;
+  int64_t sint_;
+  bool bool_;
+};
+
+class mvt_feature_view {
+public:
+  mvt_feature_view(wire_span msg) : has_id_(false), id_(0), type_(Tile::UNKNOWN) {
+    wire_reader in(msg);
+    while(in.next()){
+      switch(in.field){
+      case Feature::kIdFieldNumber:
+        in.expect(WIRE_VARINT);
+        id_ = in.varint();
+        has_id_ = true;
+        break;
+      case Feature::kTagsFieldNumber:
+        in.varints([&](uint64_t val){ tags_.push_back(val); });
+        break;
+      case Feature::kTypeFieldNumber: {
+        in.expect(WIRE_VARINT);
+        int val = (int) in.varint();
+        if(Tile::GeomType_IsValid(val))
+          type_ = (GeomType) val;
+        break;
+      }
+      case Feature::kGeometryFieldNumber:
+        kernel_packed_uint32(in, geometry_);
+        break;
+      default:
+        in.skip();
+      }
+    }
+  }
+  bool has_id() const { return has_id_; }
+  uint64_t id() const { return id_; }
+  GeomType type() const { return type_; }
+  int tags_size() const { return tags_.size(); }
+  uint32_t tags(int i) const { return tags_.at(i); }
+  int geometry_size() const { return geometry_.size(); }
+  uint32_t geometry(int i) const { return geometry_.at(i); }
+  const std::vector<uint32_t> &geometry() const { return geometry_; }
+private:
+  bool has_id_;
+  uint64_t id_;
+  GeomType type_;
+  std::vector<uint32_t> tags_;
+  std::vector<uint32_t> geometry_;
+};
+
+class mvt_layer_view {
+public:
+  mvt_layer_view(wire_span msg) : version_(1), extent_(4096) {
+    bool has_version = false;
+    bool has_name = false;
+    wire_reader in(msg);
+    while(in.next()){
+      switch(in.field){
+      case Layer::kVersionFieldNumber:
+        in.expect(WIRE_VARINT);
+        version_ = in.varint();
+        has_version = true;
+        break;
+      case Layer::kNameFieldNumber:
+        in.expect(WIRE_LENGTH);
+        name_ = in.string();
+        has_name = true;
+        break;
+      case Layer::kFeaturesFieldNumber:
+        in.expect(WIRE_LENGTH);
+        features_.push_back(in.bytes());
+        break;
+      case Layer::kKeysFieldNumber:
+        in.expect(WIRE_LENGTH);
+        keys_.push_back(in.bytes());
+        break;
+      case Layer::kValuesFieldNumber:
+        in.expect(WIRE_LENGTH);
+        values_.push_back(in.bytes());
+        break;
+      case Layer::kExtentFieldNumber:
+        in.expect(WIRE_VARINT);
+        extent_ = in.varint();
+        break;
+      default:
+        in.skip();
+      }
+    }
+    // version and name are required fields
+    if(!has_version || !has_name)
+      throw std::runtime_error("Failed to parse mvt proto message");
+  }
+  uint32_t version() const { return version_; }
+  const std::string &name() const { return name_; }
+  uint32_t extent() const { return extent_; }
+  int keys_size() const { return keys_.size(); }
+  std::string keys(int i) const { return std::string((const char*) keys_.at(i).data, keys_.at(i).size); }
+  int values_size() const { return values_.size(); }
+  mvt_value_view values(int i) const { return mvt_value_view(values_.at(i)); }
+  int features_size() const { return features_.size(); }
+  mvt_feature_view features(int i) const { return mvt_feature_view(features_.at(i)); }
+private:
+  uint32_t version_;
+  uint32_t extent_;
+  std::string name_;
+  std::vector<wire_span> keys_;
+  std::vector<wire_span> values_;
+  std::vector<wire_span> features_;
+};
+
+static Rcpp::List decode_tile_wire(Rcpp::RawVector x, const mvt_projection *proj){
+  stats_phase phase(PHASE_MATERIALIZE);
+  std::vector<wire_span> layers;
+  wire_reader in(x.begin(), x.size());
+  while(in.next()){
+    if(in.field == Tile::kLayersFieldNumber){
+      in.expect(WIRE_LENGTH);
+      layers.push_back(in.bytes());
+    } else {
+      in.skip();
+    }
+  }
+  int n = layers.size();
+  Rcpp::List out(n);
+  for(int i = 0; i < n; i++){
+    out[i] = unmapbox(mvt_layer_view(layers[i]), proj);
   }
   return out;
 }
+
+// [[Rcpp::export]]
+Rcpp::List cpp_unserialize_mvt_wire(Rcpp::RawVector x){
+  stats_call stats("cpp_unserialize_mvt_wire", x.size());
+  return decode_tile_wire(x, NULL);
+}
+
+// Geometries as WKB, projected onto tile zxy in C++
+// [[Rcpp::export]]
+Rcpp::List cpp_unserialize_mvt_wkb(Rcpp::RawVector x, Rcpp::NumericVector zxy, bool as_latlon, bool wire){
+  stats_call stats("cpp_unserialize_mvt_wkb", x.size());
+  if(zxy.size() != 3)
+    throw std::runtime_error("zxy must have length 3");
+  mvt_projection proj = {zxy[0], zxy[1], zxy[2], as_latlon};
+  return wire ? decode_tile_wire(x, &proj) : decode_tile(x, &proj);
+}
+
+template <typename V>
+static arrow_value mvt_arrow_value(const V &val){
+  arrow_value out = {0, false, 0, 0, ""};
+  if(val.has_bool_value()){
+    out.kind = ARROW_BOOL;
+    out.b = val.bool_value();
+  } else if(val.has_double_value()){
+    out.kind = ARROW_DOUBLE;
+    out.d = val.double_value();
+  } else if(val.has_float_value()){
+    out.kind = ARROW_DOUBLE;
+    out.d = val.float_value();
+  } else if(val.has_int_value()){
+    out.kind = ARROW_INT;
+    out.i = val.int_value();
+  } else if(val.has_sint_value()){
+    out.kind = ARROW_INT;
+    out.i = val.sint_value();
+  } else if(val.has_string_value()){
+    out.kind = ARROW_STRING;
+    out.s = val.string_value();
+  } else if(val.has_uint_value()){
+    uint64_t num = val.uint_value();
+    out.kind = num > INT64_MAX ? ARROW_DOUBLE : ARROW_INT;
+    out.i = num;
+    out.d = num;
+  }
+  return out;
+}
+
+// Exports a layer as a record batch with the feature id, the geometry as WKB
+// (geoarrow.wkb) and a typed column for each key.
+template <typename L>
+static void mvt_arrow(const L &layer, const mvt_projection *proj, ArrowSchema *schema, ArrowArray *array){
+  std::vector<std::string> keys;
+  for(int i = 0; i < layer.keys_size(); i++)
+    keys.push_back(layer.keys(i));
+  std::vector<arrow_value> values;
+  for(int i = 0; i < layer.values_size(); i++)
+    values.push_back(mvt_arrow_value(layer.values(i)));
+  std::string crs = proj->latlon ? "OGC:CRS84" : "EPSG:3857";
+  std::vector<arrow_column> columns;
+  columns.push_back(arrow_column("id", "L"));
+  columns.push_back(arrow_column("geometry", "z", arrow_metadata({
+    {"ARROW:extension:name", "geoarrow.wkb"},
+    {"ARROW:extension:metadata", "{\"crs\":\"" + crs + "\"}"}
+  })));
+  int n = layer.features_size();
+  std::vector<arrow_row> rows(n);
+  for(int i = 0; i < n; i++){
+    const auto &feature = layer.features(i);
+    stats_items(1);
+    if(feature.has_id())
+      columns[0].append_uint64(feature.id());
+    else
+      columns[0].append_null();
+    wkb_writer wkb;
+    write_wkb(wkb, feature.geometry().data(), feature.geometry_size(), feature.type(), layer.extent(), proj);
+    columns[1].append_bytes(wkb.buf.data(), wkb.buf.size());
+    for(int j = 0; j + 1 < feature.tags_size(); j += 2){
+      uint32_t ival = feature.tags(j + 1);
+      if(ival >= values.size())
+        throw std::runtime_error("Tag value index out of bounds");
+      rows[i].push_back(std::make_pair(feature.tags(j), values[ival]));
+    }
+  }
+  arrow_properties(columns, keys, rows);
+  arrow_export(columns, n, schema, array);
+}
+
+// Names of the layers in the tile
+// [[Rcpp::export]]
+std::vector<std::string> cpp_mvt_layer_names(Rcpp::RawVector x){
+  std::vector<std::string> names;
+  wire_reader in(x.begin(), x.size());
+  while(in.next()){
+    if(in.field == Tile::kLayersFieldNumber){
+      in.expect(WIRE_LENGTH);
+      wire_reader layer(in.bytes());
+      std::string name;
+      while(layer.next()){
+        if(layer.field == Layer::kNameFieldNumber){
+          layer.expect(WIRE_LENGTH);
+          name = layer.string();
+        } else {
+          layer.skip();
+        }
+      }
+      names.push_back(name);
+    } else {
+      in.skip();
+    }
+  }
+  return names;
+}
+
+// Fills the nanoarrow schemas and arrays, one per layer
+// [[Rcpp::export]]
+void cpp_mvt_arrow(Rcpp::RawVector x, Rcpp::NumericVector zxy, bool as_latlon, bool wire,
+                   Rcpp::List schemas, Rcpp::List arrays){
+  stats_call stats("cpp_mvt_arrow", x.size());
+  if(zxy.size() != 3)
+    throw std::runtime_error("zxy must have length 3");
+  mvt_projection proj = {zxy[0], zxy[1], zxy[2], as_latlon};
+  stats_phase phase(PHASE_MATERIALIZE);
+  std::vector<wire_span> layers;
+  vector_tile::Tile message;
+  if(wire){
+    wire_reader in(x.begin(), x.size());
+    while(in.next()){
+      if(in.field == Tile::kLayersFieldNumber){
+        in.expect(WIRE_LENGTH);
+        layers.push_back(in.bytes());
+      } else {
+        in.skip();
+      }
+    }
+  } else {
+    stats_phase parse(PHASE_PARSE);
+    if(!message.ParseFromArray(x.begin(), x.size()))
+      throw std::runtime_error("Failed to parse mvt proto message");
+  }
+  int n = wire ? layers.size() : message.layers_size();
+  if(schemas.size() != n || arrays.size() != n)
+    throw std::runtime_error("Number of schemas and arrays does not match layers");
+  for(int i = 0; i < n; i++){
+    ArrowSchema *schema = arrow_schema_xptr(schemas[i]);
+    ArrowArray *array = arrow_array_xptr(arrays[i]);
+    if(wire){
+      mvt_arrow(mvt_layer_view(layers[i]), &proj, schema, array);
+    } else {
+      mvt_arrow(message.layers(i), &proj, schema, array);
+    }
+  }
+}
@@ -1,7 +1,10 @@
 #include "rexp.pb.h"
+#include "stats.h"
+#include "wire.h"
 #include <Rcpp.h>
+#include <climits>
 
-Rcpp::NumericVector unrexp_real(rexp::REXP message){
+Rcpp::NumericVector unrexp_real(const rexp::REXP &message){
   int len = message.realvalue_size();
   Rcpp::NumericVector out(len);
   for(int i = 0; i < len; i++)
@@ -9,7 +12,7 @@ Rcpp::NumericVector unrexp_real(rexp::REXP message){
   return out;
 }
 
-Rcpp::IntegerVector unrexp_int(rexp::REXP message){
+Rcpp::IntegerVector unrexp_int(const rexp::REXP &message){
   int len = message.intvalue_size();
   Rcpp::IntegerVector out(len);
   for(int i = 0; i < len; i++)
@@ -17,7 +20,7 @@ Rcpp::IntegerVector unrexp_int(rexp::REXP message){
   return out;
 }
 
-Rcpp::LogicalVector unrexp_bool(rexp::REXP message){
+Rcpp::LogicalVector unrexp_bool(const rexp::REXP &message){
   int len = message.booleanvalue_size();
   Rcpp::LogicalVector out(len);
   for(int i = 0; i < len; i++){
@@ -27,11 +30,11 @@ Rcpp::LogicalVector unrexp_bool(rexp::REXP message){
   return out;
 }
 
-Rcpp::StringVector unrexp_string(rexp::REXP message){
+Rcpp::StringVector unrexp_string(const rexp::REXP &message){
   int len = message.stringvalue_size();
   Rcpp::StringVector out(len);
   for(int i = 0; i < len; i++){
-    rexp::STRING val = message.stringvalue(i);
+    const rexp::STRING &val = message.stringvalue(i);
     if(val.isna()){
       out[i] = NA_STRING;
     } else {
@@ -43,46 +46,82 @@ Rcpp::StringVector unrexp_string(rexp::REXP message){
   return out;
 }
 
-Rcpp::RawVector unrexp_raw(rexp::REXP message){
-  std::string val = message.rawvalue();
+Rcpp::StringVector unrexp_string_dict(const rexp::REXP &message){
+  int n_dict = message.stringdict_size();
+  Rcpp::StringVector dict(n_dict);
+  for(int i = 0; i < n_dict; i++){
+    const std::string & val = message.stringdict(i);
+    SET_STRING_ELT(dict, i, Rf_mkCharLenCE(val.c_str(), val.length(), CE_UTF8));
+  }
+  int len = message.stringindex_size();
+  Rcpp::StringVector out(len);
+  for(int i = 0; i < len; i++){
+    uint32_t index = message.stringindex(i);
+    if(index > (uint32_t) n_dict)
+      throw std::runtime_error("String index out of bounds");
+    SET_STRING_ELT(out, i, index ? STRING_ELT(dict, index - 1) : NA_STRING);
+  }
+  return out;
+}
+
+Rcpp::LogicalVector unrexp_bool_bits(const rexp::REXP &message){
+  R_xlen_t len = message.length();
+  const std::string & bits = message.booleanbits();
+  const std::string & na = message.booleanna();
+  if(bits.length() < (size_t) (len + 7) / 8 || (na.length() && na.length() < bits.length()))
+    throw std::runtime_error("Logical bits are shorter than vector length");
+  Rcpp::LogicalVector out(len);
+  for(R_xlen_t i = 0; i < len; i++){
+    if(na.length() && (na[i / 8] >> (i % 8)) & 1){
+      out[i] = NA_LOGICAL;
+    } else {
+      out[i] = (bits[i / 8] >> (i % 8)) & 1;
+    }
+  }
+  return out;
+}
+
+Rcpp::RawVector unrexp_raw(const rexp::REXP &message){
+  const std::string &val = message.rawvalue();
   Rcpp::RawVector out(val.length());
   val.copy((char*) out.begin(), val.length());
   return out;
 }
 
-Rcpp::ComplexVector unrexp_complex(rexp::REXP message){
+Rcpp::ComplexVector unrexp_complex(const rexp::REXP &message){
   int len = message.complexvalue_size();
   Rcpp::ComplexVector out(len);
   for(int i = 0; i < len; i++){
-    rexp::CMPLX val = message.complexvalue(i);
+    const rexp::CMPLX &val = message.complexvalue(i);
     out[i].r = val.real();
     out[i].i = val.imag();
   }
   return out;
 }
 
-Rcpp::RObject unrexp_native(rexp::REXP message){
+Rcpp::RObject unrexp_native(const rexp::REXP &message){
   if(!message.has_nativevalue())
     return R_NilValue;
-  std::string val = message.nativevalue();
+  const std::string &val = message.nativevalue();
   Rcpp::RawVector buf(val.length());
   val.copy((char*) buf.begin(), val.length());
+  stats_phase phase(PHASE_CALLBACK);
   Rcpp::Function unserialize = Rcpp::Environment::namespace_env("base")["unserialize"];
   return unserialize(buf);
 }
 
-Rcpp::RObject unrexp_object(rexp::REXP message);
-Rcpp::List unrexp_list(rexp::REXP message){
+Rcpp::RObject unrexp_object(const rexp::REXP &message);
+Rcpp::List unrexp_list(const rexp::REXP &message){
   int len = message.rexpvalue_size();
   Rcpp::List out(len);
   for(int i = 0; i < len; i++){
-    rexp::REXP obj = message.rexpvalue(i);
+    const rexp::REXP &obj = message.rexpvalue(i);
     out[i] = unrexp_object(obj);
   }
   return out;
 }
 
-Rcpp::RObject unrexp_any(rexp::REXP message){
+Rcpp::RObject unrexp_any(const rexp::REXP &message){
   rexp::REXP_RClass type = message.rclass();
   switch(type){
     case rexp::REXP_RClass_NULLTYPE: return R_NilValue;
@@ -94,12 +133,16 @@ Rcpp::RObject unrexp_any(rexp::REXP message){
     case rexp::REXP_RClass_COMPLEX: return unrexp_complex(message);
     case rexp::REXP_RClass_NATIVE: return unrexp_native(message);
     case rexp::REXP_RClass_LIST: return unrexp_list(message);
+    case rexp::REXP_RClass_STRINGDICT: return unrexp_string_dict(message);
+    case rexp::REXP_RClass_LOGICALBITS: return unrexp_bool_bits(message);
     default: throw std::runtime_error("Unsupported rclass type");
   }
 }
 
-Rcpp::RObject unrexp_object(rexp::REXP message){
+Rcpp::RObject unrexp_object(const rexp::REXP &message){
   Rcpp::RObject object = unrexp_any(message);
+  stats_items(1);
+  stats_est_alloc(message.rclass() != rexp::REXP_RClass_NULLTYPE);
   int len = message.attrname_size();
   if(message.rclass() != rexp::REXP_RClass_NATIVE){
     for(int i = 0; i < len; i++){
@@ -113,8 +156,348 @@ Rcpp::RObject unrexp_object(rexp::REXP message){
 
 // [[Rcpp::export]]
 Rcpp::RObject cpp_unserialize_pb(Rcpp::RawVector x){
+  stats_call stats("cpp_unserialize_pb", x.size());
+  if(x.size() > INT_MAX)
+    throw std::runtime_error("Message exceeds the 2GB limit of a protobuf message");
   rexp::REXP message;
-  if(!message.ParseFromArray(x.begin(), x.size()))
-    throw std::runtime_error("Failed to parse protobuf message");
+  {
+    stats_phase phase(PHASE_PARSE);
+    if(!message.ParseFromArray(x.begin(), x.size()))
+      throw std::runtime_error("Failed to parse protobuf message");
+  }
+  stats_phase phase(PHASE_MATERIALIZE);
   return unrexp_object(message);
 }
+
+/* Decoder for options(protolite.decoder = "wire"). This reads the wire format
+ * straight into R vectors, without creating REXP, STRING or CMPLX messages.
+ * Each message is scanned twice: first to find the rclass, the number of values
+ * and the attributes, and then to fill the vector. The output is identical to
+ * unrexp_object() above. */
+
+typedef rexp::REXP REXP;
+
+struct rexp_wire {
+  wire_span msg;
+  int rclass;
+  R_xlen_t n_real, n_int, n_bool, n_string, n_complex, n_list, n_dict, n_index;
+  bool has_native;
+  wire_span raw, native, bits, na;
+  uint64_t length;
+  std::vector<wire_span> attr_names;
+  std::vector<wire_span> attr_values;
+};
+
+static void rexp_wire_scan(rexp_wire &x){
+  wire_reader in(x.msg);
+  while(in.next()){
+    switch(in.field){
+    case REXP::kRclassFieldNumber: {
+      in.expect(WIRE_VARINT);
+      int val = (int) in.varint();
+      if(rexp::REXP_RClass_IsValid(val))
+        x.rclass = val;
+      break;
+    }
+    case REXP::kRealValueFieldNumber:
+      if(in.type == WIRE_LENGTH){
+        wire_span span = in.bytes();
+        if(span.size % 8)
+          throw std::runtime_error("Failed to parse protobuf message");
+        x.n_real += span.size / 8;
+      } else {
+        in.expect(WIRE_FIXED64);
+        in.skip();
+        x.n_real++;
+      }
+      break;
+    case REXP::kIntValueFieldNumber:
+      x.n_int += in.count_varints();
+      break;
+    case REXP::kBooleanValueFieldNumber:
+      in.varints([&](uint64_t val){
+        x.n_bool += rexp::REXP_RBOOLEAN_IsValid((int) val);
+      });
+      break;
+    case REXP::kStringValueFieldNumber:
+      in.expect(WIRE_LENGTH);
+      in.skip();
+      x.n_string++;
+      break;
+    case REXP::kRawValueFieldNumber:
+      in.expect(WIRE_LENGTH);
+      x.raw = in.bytes();
+      break;
+    case REXP::kComplexValueFieldNumber:
+      in.expect(WIRE_LENGTH);
+      in.skip();
+      x.n_complex++;
+      break;
+    case REXP::kRexpValueFieldNumber:
+      in.expect(WIRE_LENGTH);
+      in.skip();
+      x.n_list++;
+      break;
+    case REXP::kAttrNameFieldNumber:
+      in.expect(WIRE_LENGTH);
+      x.attr_names.push_back(in.bytes());
+      break;
+    case REXP::kAttrValueFieldNumber:
+      in.expect(WIRE_LENGTH);
+      x.attr_values.push_back(in.bytes());
+      break;
+    case REXP::kNativeValueFieldNumber:
+      in.expect(WIRE_LENGTH);
+      x.native = in.bytes();
+      x.has_native = true;
+      break;
+    case REXP::kStringDictFieldNumber:
+      in.expect(WIRE_LENGTH);
+      in.skip();
+      x.n_dict++;
+      break;
+    case REXP::kStringIndexFieldNumber:
+      x.n_index += in.count_varints();
+      break;
+    case REXP::kBooleanBitsFieldNumber:
+      in.expect(WIRE_LENGTH);
+      x.bits = in.bytes();
+      break;
+    case REXP::kBooleanNAFieldNumber:
+      in.expect(WIRE_LENGTH);
+      x.na = in.bytes();
+      break;
+    case REXP::kLengthFieldNumber:
+      in.expect(WIRE_VARINT);
+      x.length = in.varint();
+      break;
+    default:
+      in.skip();
+    }
+  }
+  // rclass is a required field
+  if(x.rclass < 0)
+    throw std::runtime_error("Failed to parse protobuf message");
+}
+
+// Calls fun() with the reader positioned at each occurrence of a field
+template <typename F>
+static void rexp_wire_each(const rexp_wire &x, uint32_t field, F fun){
+  wire_reader in(x.msg);
+  while(in.next()){
+    if(in.field == field){
+      fun(in);
+    } else {
+      in.skip();
+    }
+  }
+}
+
+static Rcpp::NumericVector unwire_real(const rexp_wire &x){
+  Rcpp::NumericVector out(x.n_real);
+  double *ptr = out.begin();
+  rexp_wire_each(x, REXP::kRealValueFieldNumber, [&](wire_reader &in){
+    if(in.type == WIRE_LENGTH){
+      wire_span span = in.bytes();
+      memcpy(ptr, span.data, span.size);
+      ptr += span.size / 8;
+    } else {
+      *ptr++ = in.real();
+    }
+  });
+  return out;
+}
+
+static Rcpp::IntegerVector unwire_int(const rexp_wire &x){
+  Rcpp::IntegerVector out(x.n_int);
+  int *ptr = out.begin();
+  rexp_wire_each(x, REXP::kIntValueFieldNumber, [&](wire_reader &in){
+    in.varints([&](uint64_t val){
+      *ptr++ = zigzag32((uint32_t) val);
+    });
+  });
+  return out;
+}
+
+static Rcpp::LogicalVector unwire_bool(const rexp_wire &x){
+  Rcpp::LogicalVector out(x.n_bool);
+  int *ptr = out.begin();
+  rexp_wire_each(x, REXP::kBooleanValueFieldNumber, [&](wire_reader &in){
+    in.varints([&](uint64_t val){
+      int bool_val = (int) val;
+      if(bool_val == rexp::REXP_RBOOLEAN_NA){
+        *ptr++ = NA_LOGICAL;
+      } else if(rexp::REXP_RBOOLEAN_IsValid(bool_val)){
+        *ptr++ = bool_val;
+      }
+    });
+  });
+  return out;
+}
+
+static SEXP unwire_char(wire_span span){
+  if(span.size > INT_MAX)
+    throw std::runtime_error("String too long for R");
+  return Rf_mkCharLenCE((const char*) span.data, span.size, CE_UTF8);
+}
+
+static Rcpp::StringVector unwire_string(const rexp_wire &x){
+  Rcpp::StringVector out(x.n_string);
+  R_xlen_t i = 0;
+  rexp_wire_each(x, REXP::kStringValueFieldNumber, [&](wire_reader &in){
+    wire_reader str(in.bytes());
+    wire_span val = {(const uint8_t*) "", 0};
+    bool isna = false;
+    while(str.next()){
+      if(str.field == rexp::STRING::kStrvalFieldNumber){
+        str.expect(WIRE_LENGTH);
+        val = str.bytes();
+      } else if(str.field == rexp::STRING::kIsNAFieldNumber){
+        str.expect(WIRE_VARINT);
+        isna = str.varint() != 0;
+      } else {
+        str.skip();
+      }
+    }
+    SET_STRING_ELT(out, i++, isna ? NA_STRING : unwire_char(val));
+  });
+  return out;
+}
+
+static Rcpp::StringVector unwire_string_dict(const rexp_wire &x){
+  Rcpp::StringVector dict(x.n_dict);
+  R_xlen_t i = 0;
+  rexp_wire_each(x, REXP::kStringDictFieldNumber, [&](wire_reader &in){
+    SET_STRING_ELT(dict, i++, unwire_char(in.bytes()));
+  });
+  Rcpp::StringVector out(x.n_index);
+  i = 0;
+  rexp_wire_each(x, REXP::kStringIndexFieldNumber, [&](wire_reader &in){
+    in.varints([&](uint64_t val){
+      uint32_t index = (uint32_t) val;
+      if(index > (uint64_t) x.n_dict)
+        throw std::runtime_error("String index out of bounds");
+      SET_STRING_ELT(out, i++, index ? STRING_ELT(dict, index - 1) : NA_STRING);
+    });
+  });
+  return out;
+}
+
+static Rcpp::LogicalVector unwire_bool_bits(const rexp_wire &x){
+  R_xlen_t len = x.length;
+  const uint8_t *bits = x.bits.data;
+  const uint8_t *na = x.na.size ? x.na.data : NULL;
+  if(x.bits.size < (size_t) (len + 7) / 8 || (na && x.na.size < x.bits.size))
+    throw std::runtime_error("Logical bits are shorter than vector length");
+  Rcpp::LogicalVector out(len);
+  for(R_xlen_t i = 0; i < len; i++){
+    if(na && (na[i / 8] >> (i % 8)) & 1){
+      out[i] = NA_LOGICAL;
+    } else {
+      out[i] = (bits[i / 8] >> (i % 8)) & 1;
+    }
+  }
+  return out;
+}
+
+static Rcpp::RawVector unwire_raw(const rexp_wire &x){
+  Rcpp::RawVector out(x.raw.size);
+  if(x.raw.size)
+    memcpy(out.begin(), x.raw.data, x.raw.size);
+  return out;
+}
+
+static Rcpp::ComplexVector unwire_complex(const rexp_wire &x){
+  Rcpp::ComplexVector out(x.n_complex);
+  Rcomplex *ptr = out.begin();
+  rexp_wire_each(x, REXP::kComplexValueFieldNumber, [&](wire_reader &in){
+    wire_reader val(in.bytes());
+    double re = 0, im = 0;
+    bool has_imag = false;
+    while(val.next()){
+      if(val.field == rexp::CMPLX::kRealFieldNumber){
+        val.expect(WIRE_FIXED64);
+        re = val.real();
+      } else if(val.field == rexp::CMPLX::kImagFieldNumber){
+        val.expect(WIRE_FIXED64);
+        im = val.real();
+        has_imag = true;
+      } else {
+        val.skip();
+      }
+    }
+    // imag is a required field
+    if(!has_imag)
+      throw std::runtime_error("Failed to parse protobuf message");
+    ptr->r = re;
+    ptr->i = im;
+    ptr++;
+  });
+  return out;
+}
+
+static Rcpp::RObject unwire_native(const rexp_wire &x){
+  if(!x.has_native)
+    return R_NilValue;
+  Rcpp::RawVector buf(x.native.size);
+  if(x.native.size)
+    memcpy(buf.begin(), x.native.data, x.native.size);
+  stats_phase phase(PHASE_CALLBACK);
+  Rcpp::Function unserialize = Rcpp::Environment::namespace_env("base")["unserialize"];
+  return unserialize(buf);
+}
+
+static Rcpp::RObject unwire_object(wire_span msg);
+static Rcpp::List unwire_list(const rexp_wire &x){
+  Rcpp::List out(x.n_list);
+  R_xlen_t i = 0;
+  rexp_wire_each(x, REXP::kRexpValueFieldNumber, [&](wire_reader &in){
+    out[i++] = unwire_object(in.bytes());
+  });
+  return out;
+}
+
+static Rcpp::RObject unwire_any(const rexp_wire &x){
+  switch(x.rclass){
+    case rexp::REXP_RClass_NULLTYPE: return R_NilValue;
+    case rexp::REXP_RClass_REAL: return unwire_real(x);
+    case rexp::REXP_RClass_INTEGER : return unwire_int(x);
+    case rexp::REXP_RClass_LOGICAL: return unwire_bool(x);
+    case rexp::REXP_RClass_STRING: return unwire_string(x);
+    case rexp::REXP_RClass_RAW: return unwire_raw(x);
+    case rexp::REXP_RClass_COMPLEX: return unwire_complex(x);
+    case rexp::REXP_RClass_NATIVE: return unwire_native(x);
+    case rexp::REXP_RClass_LIST: return unwire_list(x);
+    case rexp::REXP_RClass_STRINGDICT: return unwire_string_dict(x);
+    case rexp::REXP_RClass_LOGICALBITS: return unwire_bool_bits(x);
+    default: throw std::runtime_error("Unsupported rclass type");
+  }
+}
+
+static Rcpp::RObject unwire_object(wire_span msg){
+  rexp_wire x = {};
+  x.msg = msg;
+  x.rclass = -1;
+  rexp_wire_scan(x);
+  Rcpp::RObject object = unwire_any(x);
+  stats_items(1);
+  stats_est_alloc(x.rclass != rexp::REXP_RClass_NULLTYPE);
+  if(x.attr_values.size() < x.attr_names.size())
+    throw std::runtime_error("Missing attribute value in protobuf message");
+  if(x.rclass != rexp::REXP_RClass_NATIVE){
+    for(size_t i = 0; i < x.attr_names.size(); i++){
+      std::string name((const char*) x.attr_names[i].data, x.attr_names[i].size);
+      Rcpp::RObject val = unwire_object(x.attr_values[i]);
+      object.attr(name) = val;
+    }
+  }
+  return object;
+}
+
+// [[Rcpp::export]]
+Rcpp::RObject cpp_unserialize_pb_wire(Rcpp::RawVector x){
+  stats_call stats("cpp_unserialize_pb_wire", x.size());
+  stats_phase phase(PHASE_MATERIALIZE);
+  wire_span msg = {x.begin(), (size_t) x.size()};
+  return unwire_object(msg);
+}
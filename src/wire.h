@@ -0,0 +1,169 @@
+#ifndef PROTOLITE_WIRE_H
+#define PROTOLITE_WIRE_H
+
+// Minimal reader for the protobuf wire format. This is used where we want to
+// scan or skip parts of a message without parsing it into the generated classes.
+// See https://protobuf.dev/programming-guides/encoding/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdexcept>
+#include <string>
+
+#define WIRE_VARINT 0
+#define WIRE_FIXED64 1
+#define WIRE_LENGTH 2
+#define WIRE_FIXED32 5
+
+static inline int32_t zigzag32(uint32_t x){
+  return (int32_t) ((x >> 1) ^ (~(x & 1) + 1));
+}
+
+static inline int64_t zigzag64(uint64_t x){
+  return (int64_t) ((x >> 1) ^ (~(x & 1) + 1));
+}
+
+// A view on a slice of the input buffer
+struct wire_span {
+  const uint8_t *data;
+  size_t size;
+};
+
+class wire_reader {
+public:
+  const uint8_t *pos;
+  const uint8_t *end;
+  uint32_t field;
+  uint32_t type;
+
+  wire_reader(const void *buf, size_t len) :
+    pos((const uint8_t*) buf), end((const uint8_t*) buf + len), field(0), type(0) {}
+
+  wire_reader(wire_span span) :
+    pos(span.data), end(span.data + span.size), field(0), type(0) {}
+
+  bool done() const {
+    return pos >= end;
+  }
+
+  size_t remaining() const {
+    return end - pos;
+  }
+
+  uint64_t varint(){
+    if(pos < end && *pos < 0x80)
+      return *pos++;
+    uint64_t val = 0;
+    for(int shift = 0; shift < 64; shift += 7){
+      if(pos >= end)
+        throw std::runtime_error("Truncated varint in protobuf message");
+      uint8_t byte = *pos++;
+      val |= (uint64_t) (byte & 0x7f) << shift;
+      if(byte < 0x80)
+        return val;
+    }
+    throw std::runtime_error("Malformed varint in protobuf message");
+  }
+
+  // Reads the next tag. Returns false at the end of the message.
+  bool next(){
+    if(done())
+      return false;
+    uint64_t key = varint();
+    field = key >> 3;
+    type = key & 0x7;
+    if(field == 0)
+      throw std::runtime_error("Invalid field number 0 in protobuf message");
+    return true;
+  }
+
+  uint64_t fixed64(){
+    need(8);
+    uint64_t val;
+    memcpy(&val, pos, 8);
+    pos += 8;
+    return val;
+  }
+
+  uint32_t fixed32(){
+    need(4);
+    uint32_t val;
+    memcpy(&val, pos, 4);
+    pos += 4;
+    return val;
+  }
+
+  double real(){
+    uint64_t bits = fixed64();
+    double val;
+    memcpy(&val, &bits, 8);
+    return val;
+  }
+
+  // Payload of a length-delimited field
+  wire_span bytes(){
+    uint64_t len = varint();
+    need(len);
+    wire_span out = {pos, (size_t) len};
+    pos += len;
+    return out;
+  }
+
+  std::string string(){
+    wire_span span = bytes();
+    return std::string((const char*) span.data, span.size);
+  }
+
+  // Calls fun() for each value of a repeated varint field, packed or not
+  template <typename F>
+  void varints(F fun){
+    if(type == WIRE_LENGTH){
+      wire_reader packed(bytes());
+      while(!packed.done())
+        fun(packed.varint());
+    } else {
+      expect(WIRE_VARINT);
+      fun(varint());
+    }
+  }
+
+  // Number of values in a repeated varint field, without decoding them
+  size_t count_varints(){
+    if(type != WIRE_LENGTH){
+      expect(WIRE_VARINT);
+      varint();
+      return 1;
+    }
+    wire_span span = bytes();
+    size_t n = 0;
+    for(size_t i = 0; i < span.size; i++)
+      n += span.data[i] < 0x80;
+    return n;
+  }
+
+  // Checks the wire type of the current field before reading its value
+  void expect(uint32_t wiretype) const {
+    if(type != wiretype)
+      throw std::runtime_error("Unexpected wire type in protobuf message");
+  }
+
+  // Skips the value of the current field
+  void skip(){
+    switch(type){
+    case WIRE_VARINT: varint(); return;
+    case WIRE_FIXED64: need(8); pos += 8; return;
+    case WIRE_LENGTH: bytes(); return;
+    case WIRE_FIXED32: need(4); pos += 4; return;
+    }
+    throw std::runtime_error("Unsupported wire type in protobuf message");
+  }
+
+private:
+  void need(uint64_t len) const {
+    if(len > (uint64_t) (end - pos))
+      throw std::runtime_error("Truncated protobuf message");
+  }
+};
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef PROTOLITE_WKB_H
+#define PROTOLITE_WKB_H
+
+// Minimal writer and reader for well-known binary (WKB) geometries. Output is
+// little endian, with ISO type codes for Z and ZM coordinates. The reader also
+// accepts big endian and EWKB (PostGIS) type codes.
+// See https://libgeos.org/specifications/wkb/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdexcept>
+#include <string>
+
+#define WKB_POINT 1
+#define WKB_LINESTRING 2
+#define WKB_POLYGON 3
+#define WKB_MULTIPOINT 4
+#define WKB_MULTILINESTRING 5
+#define WKB_MULTIPOLYGON 6
+#define WKB_GEOMETRYCOLLECTION 7
+
+class wkb_writer {
+public:
+  std::string buf;
+
+  // Header of a geometry with 2, 3 (Z) or 4 (ZM) dimensions
+  void geometry(uint32_t type, size_t dim){
+    if(dim < 2 || dim > 4)
+      throw std::runtime_error("WKB geometries must have 2, 3 or 4 dimensions");
+    buf.push_back(1);
+    uint32(type + (dim == 3 ? 1000 : dim == 4 ? 3000 : 0));
+  }
+
+  void uint32(uint32_t val){
+    uint8_t le[4] = {(uint8_t) val, (uint8_t) (val >> 8), (uint8_t) (val >> 16), (uint8_t) (val >> 24)};
+    buf.append((const char*) le, 4);
+  }
+
+  void real(double val){
+    uint64_t bits;
+    memcpy(&bits, &val, 8);
+    uint8_t le[8];
+    for(int i = 0; i < 8; i++)
+      le[i] = (uint8_t) (bits >> (8 * i));
+    buf.append((const char*) le, 8);
+  }
+
+  void point(const double *vals, size_t dim){
+    for(size_t i = 0; i < dim; i++)
+      real(vals[i]);
+  }
+};
+
+class wkb_reader {
+public:
+  const uint8_t *pos;
+  const uint8_t *end;
+
+  wkb_reader(const void *buf, size_t len) :
+    pos((const uint8_t*) buf), end((const uint8_t*) buf + len), little(true) {}
+
+  bool done() const {
+    return pos >= end;
+  }
+
+  // Reads the byte order and type of a geometry. Returns the base type (1-7)
+  // and sets the number of dimensions.
+  uint32_t geometry(size_t *dim){
+    need(1);
+    uint8_t order = *pos++;
+    if(order > 1)
+      throw std::runtime_error("Invalid byte order in WKB geometry");
+    little = order == 1;
+    uint32_t type = uint32();
+    bool has_z = type & 0x80000000;
+    bool has_m = type & 0x40000000;
+    bool has_srid = type & 0x20000000;
+    type &= 0x0fffffff;
+    if(type >= 3000){
+      has_z = has_m = true;
+    } else if(type >= 2000){
+      has_m = true;
+    } else if(type >= 1000){
+      has_z = true;
+    }
+    type %= 1000;
+    if(type < WKB_POINT || type > WKB_GEOMETRYCOLLECTION)
+      throw std::runtime_error("Unsupported WKB geometry type");
+    if(has_srid)
+      uint32();
+    *dim = 2 + has_z + has_m;
+    return type;
+  }
+
+  uint32_t uint32(){
+    need(4);
+    uint32_t val = 0;
+    for(int i = 0; i < 4; i++)
+      val |= (uint32_t) pos[little ? i : 3 - i] << (8 * i);
+    pos += 4;
+    return val;
+  }
+
+  double real(){
+    need(8);
+    uint64_t bits = 0;
+    for(int i = 0; i < 8; i++)
+      bits |= (uint64_t) pos[little ? i : 7 - i] << (8 * i);
+    pos += 8;
+    double val;
+    memcpy(&val, &bits, 8);
+    return val;
+  }
+
+  // Number of elements that follows, checked against the remaining bytes
+  uint32_t count(size_t min_size){
+    uint32_t n = uint32();
+    if(min_size && n > (size_t) (end - pos) / min_size)
+      throw std::runtime_error("Truncated WKB geometry");
+    return n;
+  }
+
+private:
+  bool little;
+
+  void need(size_t n){
+    if((size_t) (end - pos) < n)
+      throw std::runtime_error("Truncated WKB geometry");
+  }
+};
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef PROTOLITE_XXHASH_H
+#define PROTOLITE_XXHASH_H
+
+// Streaming implementation of the 64-bit xxHash (XXH64) algorithm.
+// See https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t xxh_rotl(uint64_t x, int r){
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh_read64(const uint8_t *p){
+  uint64_t val;
+  memcpy(&val, p, 8);
+  return val;
+}
+
+static inline uint32_t xxh_read32(const uint8_t *p){
+  uint32_t val;
+  memcpy(&val, p, 4);
+  return val;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input){
+  acc += input * XXH_PRIME64_2;
+  acc = xxh_rotl(acc, 31);
+  return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t val){
+  acc ^= xxh_round(0, val);
+  return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+class xxh64 {
+public:
+  xxh64(uint64_t seed = 0) : total(0), buffered(0) {
+    acc[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+    acc[1] = seed + XXH_PRIME64_2;
+    acc[2] = seed;
+    acc[3] = seed - XXH_PRIME64_1;
+  }
+
+  void update(const void *data, size_t len){
+    const uint8_t *p = (const uint8_t*) data;
+    const uint8_t *end = p + len;
+    total += len;
+    if(buffered + len < 32){
+      if(len)
+        memcpy(buffer + buffered, p, len);
+      buffered += len;
+      return;
+    }
+    if(buffered){
+      size_t fill = 32 - buffered;
+      memcpy(buffer + buffered, p, fill);
+      stripe(buffer);
+      p += fill;
+      buffered = 0;
+    }
+    for(; p + 32 <= end; p += 32)
+      stripe(p);
+    buffered = end - p;
+    if(buffered)
+      memcpy(buffer, p, buffered);
+  }
+
+  uint64_t digest() const {
+    uint64_t h;
+    if(total >= 32){
+      h = xxh_rotl(acc[0], 1) + xxh_rotl(acc[1], 7) + xxh_rotl(acc[2], 12) + xxh_rotl(acc[3], 18);
+      for(int i = 0; i < 4; i++)
+        h = xxh_merge(h, acc[i]);
+    } else {
+      h = acc[2] + XXH_PRIME64_5;
+    }
+    h += total;
+    const uint8_t *p = buffer;
+    const uint8_t *end = buffer + buffered;
+    for(; p + 8 <= end; p += 8){
+      h ^= xxh_round(0, xxh_read64(p));
+      h = xxh_rotl(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if(p + 4 <= end){
+      h ^= (uint64_t) xxh_read32(p) * XXH_PRIME64_1;
+      h = xxh_rotl(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+      p += 4;
+    }
+    for(; p < end; p++){
+      h ^= *p * XXH_PRIME64_5;
+      h = xxh_rotl(h, 11) * XXH_PRIME64_1;
+    }
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+  }
+
+private:
+  void stripe(const uint8_t *p){
+    for(int i = 0; i < 4; i++)
+      acc[i] = xxh_round(acc[i], xxh_read64(p + 8 * i));
+  }
+  uint64_t acc[4];
+  uint64_t total;
+  size_t buffered;
+  uint8_t buffer[32];
+};
+
+static inline uint64_t xxh64_hash(const void *data, size_t len, uint64_t seed = 0){
+  xxh64 state(seed);
+  state.update(data, len);
+  return state.digest();
+}
+
+#endif